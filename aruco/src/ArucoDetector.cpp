@@ -3,6 +3,8 @@
 #include <string>
 #include <iostream>
 #include <math.h>
+#include <float.h>
+#include <algorithm>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -10,9 +12,14 @@
 #include <opencv2/photo/photo.hpp>
 
 #include "SquareFinder.cpp"
+#include "ContourTracer.cpp"
+#include "ComponentFinder.cpp"
+#include "EdgeFinder.cpp"
 #include "CornerRefinement.cpp"
 #include "ArucoMarker.cpp"
 #include "ArucoMarkerInfo.cpp"
+#include "StageTimer.cpp"
+#include "PoseEstimator.cpp"
 
 #define DEBUG false
 
@@ -28,61 +35,1543 @@ class ArucoDetector
 {	
 	public:
 		/**
-		 * Process image to identify aruco markers.
-		 * Applies pre-processing over the frame and get list of quads in the frame.
-		 * @param frame Frame to be processed.
+		 * Region of the frame that is thresholded and searched for quads independently.
+		 */
+		class Tile
+		{
+			public:
+				/**
+				 * Region of the frame owned by the tile, quads are kept by the tile that contains their center.
+				 */
+				Rect core;
+
+				/**
+				 * Region of the frame searched, the core expanded by the overlap.
+				 */
+				Rect rect;
+
+				/**
+				 * Threshold, contour and quad buffers of the tile.
+				 */
+				Mat thresh;
+				vector<vector<Point>> contours;
+				vector<Vec4i> hierarchy;
+				vector<Point> stack;
+				vector<Point> approx;
+				vector<Quadrilateral> quads;
+				unsigned int quadCount;
+
+				/**
+				 * Number of contours found and rejected by each check in the tile in the last frame.
+				 */
+				SquareFinder::Stats stats;
+
+				/**
+				 * Buffers of the other quad backends, only the one selected by the detector is used.
+				 */
+				ContourTracer tracer;
+				ComponentFinder components;
+				EdgeFinder edges;
+
+				/**
+				 * Buffer allocations done by the tile in the last frame.
+				 */
+				unsigned long allocations;
+
+				/**
+				 * Time in milliseconds spent thresholding and finding quads in the tile in the last frame.
+				 */
+				double thresholdTime, contoursTime;
+
+				/**
+				 * Threshold block size of the tile in the searched image, thresholded from the integral image.
+				 * If 0 the tile is thresholded with adaptiveThreshold and the detector search block size.
+				 */
+				int blockSize;
+
+				Tile(Rect _core, Rect _rect)
+				{
+					core = _core;
+					rect = _rect;
+					quadCount = 0;
+					allocations = 0;
+					thresholdTime = 0.0;
+					contoursTime = 0.0;
+					blockSize = 0;
+				}
+
+				/**
+				 * Size of the contour and quad buffers of every backend, used to count the allocations done while finding quads.
+				 * @return Total capacity of the buffers.
+				 */
+				size_t capacity() const
+				{
+					size_t vectors = quads.capacity() + contours.capacity() + hierarchy.capacity() + stack.capacity() + approx.capacity() + innerCapacity(contours) + tracer.contour.capacity() + tracer.approx.capacity() +
+						components.contours.capacity() + components.approx.capacity() + components.hierarchy.capacity() + innerCapacity(components.contours) + edges.contours.capacity() + edges.hierarchy.capacity() + edges.approx.capacity() + edges.side.capacity() + innerCapacity(edges.contours);
+					size_t images = tracer.labels.total() + components.inverted.total() + components.labels.total() * 4 + components.mask.total() + edges.edges.total() + edges.dilated.total();
+
+					return vectors + images;
+				}
+		};
+
+		/**
+		 * Board buffers used by one stripe of the parallel decode.
+		 */
+		class DecodeStripe
+		{
+			public:
+				/**
+				 * Perspective corrected board and its 7x7 resampled, grayscale and binary versions.
+				 */
+				Mat board, cells, cellsGray, binary;
+
+				/**
+				 * Buffer allocations done by the stripe in the last frame.
+				 */
+				unsigned long allocations;
+
+				DecodeStripe()
+				{
+					allocations = 0;
+				}
+		};
+
+		/**
+		 * Higher values allow detection of more distorted markers but performance is slower.
+		 */
+		float limitCosine;
+
+		/**
+		 * Adaptive threshold block size.
+		 */
+		int thresholdBlockSize;
+
+		/**
+		 * Minimum area of the quads considered as marker candidates.
+		 */
+		int minArea;
+
+		/**
+		 * Max error percentage relative to the quad perimeter used in the polygon approximation.
+		 */
+		double maxError;
+
+		/**
+		 * Max aspect ratio of the bounding box of the contours tested as quads, more elongated contours are rejected before the polygon approximation.
+		 * 0 disables the check.
+		 */
+		double maxAspect;
+
+		/**
+		 * If true the marker cells are sampled directly from the grayscale image using the quad homography.
+		 * Otherwise each quad is warped into a 49x49 board that is resized to 7x7 and binarized (slower).
+		 */
+		bool sampleCells;
+
+		/**
+		 * Number of samples taken per cell on each axis when sampling cells directly.
+		 */
+		int cellSamples;
+
+		/**
+		 * Number of threads used to decode the marker candidates.
+		 * If set to 1 candidates are decoded serially, 0 uses the default number of threads of OpenCV.
+		 * The OpenCV thread pool size (setNumThreads) limits the maximum concurrency.
+		 */
+		int threads;
+
+		/**
+		 * Size in pixels of the tiles used to threshold and find quads in parallel, 0 processes the whole frame at once.
+		 * Each quad is only kept by the tile that contains its center, so quads that straddle tile seams are not duplicated.
+		 */
+		int tileSize;
+
+		/**
+		 * Overlap in pixels added to each side of the tiles, 0 uses a quarter of the tile size.
+		 * Markers crossing a seam are only found if their half size is smaller than the overlap.
+		 */
+		int tileOverlap;
+
+		/**
+		 * If true only the regions around the markers found in the previous frame are searched.
+		 * A full frame scan is done every trackingInterval frames or when a tracked marker is lost.
+		 */
+		bool tracking;
+
+		/**
+		 * Number of frames between full frame scans in tracking mode.
+		 */
+		int trackingInterval;
+
+		/**
+		 * Margin added around each tracked marker bounding box relative to its size.
+		 */
+		float trackingMargin;
+
+		/**
+		 * True if the last frame was fully scanned, false if only the tracked regions were searched.
+		 */
+		bool fullScan;
+
+		/**
+		 * Factor (1, 2 or 4) used to downscale the grayscale image before searching quads, 0 selects it automatically from minArea.
+		 * Quads are scaled back and decoded against the full resolution image. Tile sizes are in downscaled pixels.
+		 */
+		int decimation;
+
+		/**
+		 * If true the contours are searched as a tree and the small children of the dark quads accepted (the bit cells of the markers) are not tested.
+		 * Only used with the contours backend, the other backends do not build the contour tree.
+		 */
+		bool pruneChildren;
+
+		/**
+		 * Source of the quad candidates.
+		 * Contours and tracer find the same quads from the threshold, components traces only the dark blobs of the threshold and edges uses the Canny edges of the grayscale image.
+		 * The threshold block size (and the block size search) is not used by the edges backend.
+		 */
+		QuadBackend backend;
+
+		/**
+		 * If true quads that are the same square (nested borders found around the threshold edge of a marker, or the same quad found by several block sizes) are grouped and only one quad of each group is decoded.
+		 * The quads of a group are decoded from the most likely marker border (dark inside, smallest first) until one is valid, so a marker is found at most once.
+		 * Disabling it decodes every quad and the same marker can be found several times, only the same quad found by several block sizes is still grouped.
+		 */
+		bool suppressDuplicates;
+
+		/**
+		 * If true the corners of the quads found in the downscaled image are refined with subpixel precision in the full resolution image.
+		 */
+		bool refineCorners;
+
+		/**
+		 * Decimation factor used in the last frame.
+		 */
+		int scale;
+
+		/**
+		 * Threshold block sizes tested on the same frame (up to 32), if empty only thresholdBlockSize is used.
+		 * All the block sizes share one integral image, the quads found by more than one block size are decoded once.
+		 * Block sizes are processed in parallel if threads is not 1, tiles are not used when searching several block sizes.
+		 * Not used by the edges backend.
+		 */
+		vector<int> blockSizes;
+
+		/**
+		 * Average of the block sizes that found the most markers in the last block sizes search (rounded to odd).
+		 * Is thresholdBlockSize if no marker was found.
+		 */
+		int bestBlockSize;
+
+		/**
+		 * Number of markers found by each block size in the last block sizes search.
+		 */
+		vector<unsigned int> blockMarkers;
+
+		/**
+		 * Markers found in the last frame processed by detect.
+		 */
+		vector<ArucoMarker> markers;
+
+		/**
+		 * Quads found in the last frame, used as a pool only the first quadCount entries are valid.
+		 */
+		vector<Quadrilateral> quads;
+
+		/**
+		 * Number of valid quads in the quads pool.
+		 */
+		unsigned int quadCount;
+
+		/**
+		 * Number of buffer allocations performed by the detector since it was created.
+		 * Only counts buffers owned by the detector, allocations done internally by OpenCV are not visible here.
+		 */
+		unsigned long allocations;
+
+		/**
+		 * Number of buffer allocations performed while processing the last frame.
+		 * After the first frames (and while the resolution stays the same) this value should be zero.
+		 */
+		unsigned long frameAllocations;
+
+		/**
+		 * Number of quads decoded in the last frame, in tracking mode it includes the quads of the tracked regions and of the full scan.
+		 */
+		unsigned int candidateCount;
+
+		/**
+		 * Number of contours found and rejected by each quad check in the last frame, summed over all the tiles searched.
+		 */
+		SquareFinder::Stats squareStats;
+
+		/**
+		 * Time in milliseconds spent in each step of the last frame, only measured when ARUCO_PROFILE is enabled.
+		 * Conversion includes the grayscale conversion and the downscale, contours includes the quad corners refinement.
+		 * When tiles are processed in parallel the threshold and contours times are the sum of the time of each tile.
+		 */
+		double conversionTime, thresholdTime, contoursTime, decodeTime;
+
+		/**
+		 * Decoded candidates, one slot per quad, and the result of their validation.
+		 */
+		vector<ArucoMarker> candidates;
+		vector<uchar> valid;
+
+		/**
+		 * Grayscale version of the frame, shares the frame data when the frame is already single channel.
+		 */
+		Mat gray;
+
+		/**
+		 * Buffer where color frames are converted to grayscale.
+		 */
+		Mat converted;
+
+		/**
+		 * Image searched for quads, the grayscale image or its downscaled version.
+		 */
+		Mat search, small;
+
+		/**
+		 * Threshold block size and minimum area used on the searched image.
+		 */
+		int searchBlockSize, searchMinArea;
+
+		/**
+		 * Quad corners buffer used for subpixel refinement.
+		 */
+		vector<Point2f> corners;
+
+		/**
+		 * Regions of the frame searched for quads, each one with its own buffers.
+		 */
+		vector<Tile> tiles;
+
+		/**
+		 * Frame size and tiling parameters used to create the tiles.
+		 */
+		Size tilesFrame;
+		int tilesSize, tilesOverlap;
+
+		/**
+		 * Tiles used to search the whole frame with each of the block sizes and the integral image they share.
+		 * The integral image is 64 bit floating point, the sum of a bright 8K frame does not fit in 32 bits and its integer values are exact in a double.
+		 */
+		vector<Tile> blockTiles;
+		Mat integralImage;
+
+		/**
+		 * Block sizes that found each quad as a bit mask, only used when searching several block sizes.
+		 */
+		vector<uint32_t> quadBlocks;
+
+		/**
+		 * True if the quads were found by the block sizes search and quadBlocks is valid.
+		 */
+		bool blockQuads;
+
+		/**
+		 * Oriented area and group of each quad, and the quads sorted by group and decode preference.
+		 */
+		vector<float> quadArea;
+		vector<unsigned int> quadGroup;
+		vector<unsigned int> quadOrder;
+
+		/**
+		 * Position of each group in the sorted quads (with one extra entry for the end of the last group), its first quad and the next group in its hash bucket.
+		 */
+		vector<unsigned int> groupStart;
+		vector<unsigned int> groupFirst;
+		vector<int> gridNext;
+		unsigned int groupCount;
+
+		/**
+		 * Block sizes that found the quads of each group as a bit mask, only used when searching several block sizes.
+		 */
+		vector<uint32_t> groupBlocks;
+
+		/**
+		 * First group of each bucket of the spatial hash.
+		 */
+		vector<int> gridHead;
+
+		/**
+		 * Tiles used to search the tracked regions, only the first regionCount are used.
+		 */
+		vector<Tile> regions;
+		unsigned int regionCount;
+
+		/**
+		 * Regions and ids of the markers tracked from the previous frame.
+		 */
+		vector<Rect> trackedRegions;
+		vector<int> trackedIds;
+
+		/**
+		 * Frames processed since the last full frame scan.
+		 */
+		int framesSinceScan;
+
+		/**
+		 * Per candidate buffers, perspective corrected board and its 7x7 resampled, grayscale and binary versions.
+		 */
+		Mat board, cells, cellsGray, binary;
+
+		/**
+		 * Board buffers of each stripe when candidates are decoded in parallel, one stripe per thread.
+		 */
+		vector<DecodeStripe> stripes;
+
+		/**
+		 * Corners of the perspective corrected board.
+		 */
+		vector<Point2f> boardCorners;
+
+		/**
+		 * Empty marker used to reset marker slots before decoding.
+		 */
+		ArucoMarker blank;
+
+		/**
+		 * Create a detector, all buffers are allocated on the first frame and reused after.
 		 * @param limitCosine Higher values allow detection of more distorted markers but performance is slower
+		 * @param thresholdBlockSize Adaptive threshold block size.
+		 * @param minArea Minimum area of the marker candidates.
+		 * @param maxError Max error percentage relative to the quad perimeter.
+		 */
+		ArucoDetector(float _limitCosine = 0.7, int _thresholdBlockSize = 7, int _minArea = 100, double _maxError = 0.025)
+		{
+			limitCosine = _limitCosine;
+			thresholdBlockSize = _thresholdBlockSize;
+			minArea = _minArea;
+			maxError = _maxError;
+			maxAspect = SquareFinder::MAX_ASPECT;
+			sampleCells = true;
+			cellSamples = 1;
+			threads = 1;
+			tileSize = 0;
+			tileOverlap = 0;
+			tilesSize = -1;
+			tilesOverlap = -1;
+			tracking = false;
+			trackingInterval = 10;
+			trackingMargin = 0.5;
+			fullScan = true;
+			regionCount = 0;
+			framesSinceScan = 0;
+			decimation = 1;
+			backend = BACKEND_CONTOURS;
+			pruneChildren = false;
+			suppressDuplicates = true;
+			refineCorners = true;
+			scale = 1;
+			bestBlockSize = _thresholdBlockSize;
+			searchBlockSize = _thresholdBlockSize;
+			searchMinArea = _minArea;
+			quadCount = 0;
+			groupCount = 0;
+			blockQuads = false;
+			allocations = 0;
+			frameAllocations = 0;
+			candidateCount = 0;
+			conversionTime = 0.0;
+			thresholdTime = 0.0;
+			contoursTime = 0.0;
+			decodeTime = 0.0;
+
+			boardCorners.push_back(Point2f(0, 0));
+			boardCorners.push_back(Point2f(0, 49));
+			boardCorners.push_back(Point2f(49, 49));
+			boardCorners.push_back(Point2f(49, 0));
+		}
+
+		/**
+		 * Process image to identify aruco markers using the detector buffers.
+		 * The returned vector is owned by the detector and is overwritten on the next call.
+		 * @param frame Frame to be processed, single channel (used without copying), BGR or BGRA 8 bit image.
+		 * @return Markers found in the frame.
+		 */
+		vector<ArucoMarker> &detect(Mat frame)
+		{
+			unsigned long start = allocations;
+			candidateCount = 0;
+			squareStats.reset();
+
+			#if ARUCO_PROFILE
+				double time = StageTimer::now();
+				thresholdTime = 0.0;
+				contoursTime = 0.0;
+				decodeTime = 0.0;
+			#endif
+
+			//Create a grayscale image
+			if(frame.channels() == 1)
+			{
+				gray = frame;
+			}
+			else
+			{
+				const uchar *previous = converted.data;
+				cvtColor(frame, converted, frame.channels() == 4 ? COLOR_BGRA2GRAY : COLOR_BGR2GRAY);
+				trackBuffer(converted, previous);
+				gray = converted;
+			}
+
+			//Downscale the image used to search quads
+			updateSearch();
+
+			#if ARUCO_PROFILE
+				conversionTime = StageTimer::now() - time;
+			#endif
+
+			fullScan = true;
+
+			//Search only around the tracked markers
+			if(tracking && trackedIds.size() > 0 && framesSinceScan < trackingInterval)
+			{
+				updateRegions();
+				findQuads(regions, regionCount);
+				scaleQuads();
+				decodeQuads();
+
+				fullScan = lostTracked();
+			}
+
+			//Threshold and find quads in each tile of the whole frame
+			if(fullScan)
+			{
+				//Search with several block sizes at once, the edges backend does not threshold so a single search is done
+				if(blockSizes.size() > 0 && backend != BACKEND_EDGES)
+				{
+					searchBlocks();
+					scaleQuads();
+					decodeQuads();
+					updateBestBlockSize();
+				}
+				else
+				{
+					updateTiles(search.size());
+					findQuads(tiles, tiles.size());
+					scaleQuads();
+
+					#if DEBUG
+						imshow("Adaptive", tiles[0].thresh);
+					#endif
+
+					decodeQuads();
+				}
+			}
+
+			#if DEBUG
+				Mat quad = frame.clone();
+				SquareFinder::drawQuads(quad, vector<Quadrilateral>(quads.begin(), quads.begin() + quadCount));
+				imshow("Quads", quad);
+			#endif
+
+			if(tracking)
+			{
+				updateTracked();
+				framesSinceScan = fullScan ? 0 : framesSinceScan + 1;
+			}
+
+			frameAllocations = allocations - start;
+
+			return markers;
+		}
+
+		/**
+		 * Select the decimation factor that keeps markers of minArea at least 64 pixels in the downscaled image.
+		 * @return Decimation factor.
+		 */
+		int decimationFactor()
+		{
+			if(decimation > 0)
+			{
+				return decimation;
+			}
+
+			int factor = 4;
+
+			while(factor > 1 && minArea / (factor * factor) < 64)
+			{
+				factor /= 2;
+			}
+
+			return factor;
+		}
+
+		/**
+		 * Prepare the image searched for quads and the parameters scaled to its resolution.
+		 */
+		void updateSearch()
+		{
+			scale = decimationFactor();
+
+			if(scale > 1)
+			{
+				const uchar *previous = small.data;
+				resize(gray, small, Size(gray.cols / scale, gray.rows / scale), 0, 0, INTER_AREA);
+				trackBuffer(small, previous);
+				search = small;
+			}
+			else
+			{
+				search = gray;
+			}
+
+			searchBlockSize = std::max((thresholdBlockSize / scale) | 1, 3);
+			searchMinArea = minArea / (scale * scale);
+		}
+
+		/**
+		 * Move the quads found in the downscaled image to full resolution coordinates and refine their corners.
+		 */
+		void scaleQuads()
+		{
+			if(scale == 1 || quadCount == 0)
+			{
+				return;
+			}
+
+			#if ARUCO_PROFILE
+				double time = StageTimer::now();
+			#endif
+
+			size_t capacity = corners.capacity();
+			corners.clear();
+
+			//Center of the downscaled pixel x is at (x + 0.5) * scale - 0.5 in the full resolution image
+			for(unsigned int i = 0; i < quadCount; i++)
+			{
+				for(unsigned int j = 0; j < 4; j++)
+				{
+					Point2f &point = quads[i].points[j];
+					point.x = (point.x + 0.5f) * scale - 0.5f;
+					point.y = (point.y + 0.5f) * scale - 0.5f;
+					corners.push_back(point);
+				}
+			}
+
+			trackCapacity(capacity, corners.capacity());
+
+			if(refineCorners)
+			{
+				cornerSubPix(gray, corners, Size(scale + 1, scale + 1), Size(-1, -1), TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 10, 0.05));
+
+				for(unsigned int i = 0; i < quadCount; i++)
+				{
+					for(unsigned int j = 0; j < 4; j++)
+					{
+						quads[i].points[j] = corners[i * 4 + j];
+					}
+				}
+			}
+
+			#if ARUCO_PROFILE
+				contoursTime += StageTimer::now() - time;
+			#endif
+		}
+
+		/**
+		 * Create the tiles for a frame size, tiles are only recreated when the frame size or the tiling parameters change.
+		 * @param size Frame size.
+		 */
+		void updateTiles(Size size)
+		{
+			if(size == tilesFrame && tileSize == tilesSize && tileOverlap == tilesOverlap)
+			{
+				return;
+			}
+
+			tilesFrame = size;
+			tilesSize = tileSize;
+			tilesOverlap = tileOverlap;
+			tiles.clear();
+			allocations++;
+
+			Rect frame = Rect(0, 0, size.width, size.height);
+
+			if(tileSize <= 0 || (tileSize >= size.width && tileSize >= size.height))
+			{
+				tiles.push_back(Tile(frame, frame));
+				return;
+			}
+
+			int overlap = tileOverlap > 0 ? tileOverlap : tileSize / 4;
+
+			for(int y = 0; y < size.height; y += tileSize)
+			{
+				for(int x = 0; x < size.width; x += tileSize)
+				{
+					Rect core = Rect(x, y, tileSize, tileSize) & frame;
+					Rect rect = Rect(x - overlap, y - overlap, tileSize + 2 * overlap, tileSize + 2 * overlap) & frame;
+
+					tiles.push_back(Tile(core, rect));
+				}
+			}
+		}
+
+		/**
+		 * Threshold the region of a tile and find its quads, quads are stored in frame coordinates.
+		 * The threshold is calculated over the region expanded by half block size so the result is the same as thresholding the whole frame.
+		 * @param tile Tile to process.
+		 */
+		void findTileQuads(Tile &tile)
+		{
+			tile.allocations = 0;
+
+			#if ARUCO_PROFILE
+				double time = StageTimer::now();
+			#endif
+
+			const uchar *previous = tile.thresh.data;
+			Mat region;
+
+			//Edges are found in the grayscale image
+			if(backend == BACKEND_EDGES)
+			{
+				region = search(tile.rect);
+			}
+			else if(tile.blockSize > 0)
+			{
+				thresholdIntegral(tile.rect, tile.blockSize, tile.thresh);
+				region = tile.thresh;
+			}
+			else
+			{
+				int margin = searchBlockSize / 2;
+				Rect expanded = Rect(tile.rect.x - margin, tile.rect.y - margin, tile.rect.width + 2 * margin, tile.rect.height + 2 * margin) & Rect(0, 0, search.cols, search.rows);
+
+				adaptiveThreshold(search(expanded), tile.thresh, 255, THRESH_BINARY, ADAPTIVE_THRESH_MEAN_C, searchBlockSize, 0.0);
+				region = tile.thresh(Rect(tile.rect.x - expanded.x, tile.rect.y - expanded.y, tile.rect.width, tile.rect.height));
+			}
+
+			#if ARUCO_PROFILE
+				double thresholded = StageTimer::now();
+				tile.thresholdTime = thresholded - time;
+			#endif
+
+			if(tile.thresh.data != previous)
+			{
+				tile.allocations++;
+			}
+
+			size_t capacity = tile.capacity();
+
+			switch(backend)
+			{
+				case BACKEND_TRACER:
+					tile.quadCount = tile.tracer.findSquares(region, tile.quads, limitCosine, searchMinArea, maxError, maxAspect);
+					tile.stats = tile.tracer.stats;
+					break;
+
+				case BACKEND_COMPONENTS:
+					tile.quadCount = tile.components.findSquares(region, tile.quads, limitCosine, searchMinArea, maxError, maxAspect);
+					tile.stats = tile.components.stats;
+					break;
+
+				case BACKEND_EDGES:
+					tile.quadCount = tile.edges.findSquares(region, tile.quads, limitCosine, searchMinArea, maxError, maxAspect);
+					tile.stats = tile.edges.stats;
+					break;
+
+				default:
+					tile.quadCount = SquareFinder::findSquares(region, tile.quads, tile.contours, tile.hierarchy, tile.stack, tile.approx, limitCosine, searchMinArea, maxError, maxAspect, pruneChildren, tile.stats);
+					break;
+			}
+
+			if(tile.capacity() != capacity)
+			{
+				tile.allocations++;
+			}
+
+			//Move quads to frame coordinates
+			Point2f offset = Point2f(tile.rect.x, tile.rect.y);
+
+			for(unsigned int i = 0; i < tile.quadCount; i++)
+			{
+				for(unsigned int j = 0; j < 4; j++)
+				{
+					tile.quads[i].points[j] += offset;
+				}
+			}
+
+			#if ARUCO_PROFILE
+				tile.contoursTime = StageTimer::now() - thresholded;
+			#endif
+		}
+
+		/**
+		 * Mean adaptive threshold of a region of the searched image calculated from the integral image.
+		 * Pixels brighter than the mean of their block are set to 255, the result is the same as adaptiveThreshold except near the image border where the block is clipped to the image.
+		 * @param rect Region of the searched image.
+		 * @param blockSize Threshold block size.
+		 * @param dst Output binary image with the size of the region.
+		 */
+		void thresholdIntegral(Rect rect, int blockSize, Mat &dst)
+		{
+			dst.create(rect.height, rect.width, CV_8UC1);
+
+			int radius = blockSize / 2;
+
+			for(int y = 0; y < rect.height; y++)
+			{
+				int sy = rect.y + y;
+				int y0 = std::max(sy - radius, 0);
+				int y1 = std::min(sy + radius + 1, search.rows);
+
+				const double *top = integralImage.ptr<double>(y0);
+				const double *bottom = integralImage.ptr<double>(y1);
+				const uchar *src = search.ptr<uchar>(sy) + rect.x;
+				uchar *out = dst.ptr<uchar>(y);
+
+				for(int x = 0; x < rect.width; x++)
+				{
+					int sx = rect.x + x;
+					int x0 = std::max(sx - radius, 0);
+					int x1 = std::min(sx + radius + 1, search.cols);
+
+					double sum = bottom[x1] - bottom[x0] - top[x1] + top[x0];
+					int area = (y1 - y0) * (x1 - x0);
+
+					//Same as src > round(sum / area), the rounded mean used by adaptiveThreshold
+					out[x] = src[x] * 2.0 * area > 2.0 * sum + area ? 255 : 0;
+				}
+			}
+		}
+
+		/**
+		 * Threshold and find quads in the whole frame with each block size (in parallel if threads is not 1) sharing one integral image.
+		 * Quads found by more than one block size are merged and the block sizes that found each quad are stored in quadBlocks.
+		 */
+		void searchBlocks()
+		{
+			const uchar *previous = integralImage.data;
+			integral(search, integralImage, CV_64F);
+			trackBuffer(integralImage, previous);
+
+			unsigned int count = std::min((unsigned int) blockSizes.size(), 32u);
+			Rect frame = Rect(0, 0, search.cols, search.rows);
+
+			while(blockTiles.size() < count)
+			{
+				blockTiles.push_back(Tile(frame, frame));
+				allocations++;
+			}
+
+			for(unsigned int i = 0; i < count; i++)
+			{
+				blockTiles[i].core = frame;
+				blockTiles[i].rect = frame;
+				blockTiles[i].blockSize = std::max((blockSizes[i] / scale) | 1, 3);
+			}
+
+			if(threads == 1 || count == 1)
+			{
+				for(unsigned int i = 0; i < count; i++)
+				{
+					findTileQuads(blockTiles[i]);
+				}
+			}
+			else
+			{
+				parallel_for_(Range(0, count), TileLoop(this, &blockTiles), threads > 1 ? threads : -1);
+			}
+
+			mergeBlocks(count);
+		}
+
+		/**
+		 * Collect the quads found by each block size into the detector quads, the same quad found by several block sizes is grouped before decoding.
+		 * @param count Number of block sizes searched.
+		 */
+		void mergeBlocks(unsigned int count)
+		{
+			size_t capacity = quads.capacity() + quadBlocks.capacity();
+			quadCount = 0;
+			blockQuads = true;
+
+			for(unsigned int b = 0; b < count; b++)
+			{
+				Tile &tile = blockTiles[b];
+				allocations += tile.allocations;
+				squareStats.add(tile.stats);
+
+				#if ARUCO_PROFILE
+					thresholdTime += tile.thresholdTime;
+					contoursTime += tile.contoursTime;
+				#endif
+
+				for(unsigned int i = 0; i < tile.quadCount; i++)
+				{
+					if(quadCount == quads.size())
+					{
+						quads.push_back(Quadrilateral());
+					}
+
+					if(quadCount == quadBlocks.size())
+					{
+						quadBlocks.push_back(0);
+					}
+
+					quadBlocks[quadCount] = 1u << b;
+					quads[quadCount++].points = tile.quads[i].points;
+				}
+			}
+
+			trackCapacity(capacity, quads.capacity() + quadBlocks.capacity());
+		}
+
+		/**
+		 * Check if two quads are the same square, nested borders of a marker are a few pixels apart and overlap almost completely.
+		 * @param a Corners of the first quad.
+		 * @param areaA Area of the first quad.
+		 * @param b Corners of the second quad.
+		 * @param areaB Area of the second quad.
+		 * @return True if the smaller quad covers at least 60% of the larger and every corner of each quad is closer than a quarter of the smaller side to a corner of the other.
+		 */
+		static bool sameQuad(const vector<Point2f> &a, float areaA, const vector<Point2f> &b, float areaB)
+		{
+			if(std::min(areaA, areaB) < std::max(areaA, areaB) * 0.6f)
+			{
+				return false;
+			}
+
+			float limit = std::min(areaA, areaB) / 16.0f;
+
+			for(unsigned int i = 0; i < 4; i++)
+			{
+				float nearestA = FLT_MAX, nearestB = FLT_MAX;
+
+				for(unsigned int j = 0; j < 4; j++)
+				{
+					Point2f offset = a[i] - b[j];
+					nearestA = std::min(nearestA, offset.dot(offset));
+					offset = b[i] - a[j];
+					nearestB = std::min(nearestB, offset.dot(offset));
+				}
+
+				if(nearestA >= limit || nearestB >= limit)
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		/**
+		 * Group the quads that are the same square so only one quad of each group is decoded.
+		 * Groups are stored in a spatial hash keyed by the size level (power of two of the side) and the cell of their first quad center, the cells of a level are as large as its sides.
+		 * Quads of the same square have sides of adjacent levels and centers in adjacent cells, so each quad is only compared with the groups of 27 cells and the grouping is linear in the number of quads.
+		 * Without suppressDuplicates a quad is only grouped with the same quad found by other block sizes, so a marker is not decoded once per block size.
+		 */
+		void groupQuads()
+		{
+			size_t capacity = quadArea.capacity() + quadGroup.capacity() + quadOrder.capacity() + groupStart.capacity() + groupFirst.capacity() + groupBlocks.capacity() + gridHead.capacity() + gridNext.capacity();
+			bool grouping = suppressDuplicates || blockQuads;
+
+			quadArea.resize(quadCount);
+			quadGroup.resize(quadCount);
+			quadOrder.resize(quadCount);
+			groupStart.resize(quadCount + 1);
+			groupFirst.resize(quadCount);
+			groupBlocks.resize(quadCount);
+			gridNext.resize(quadCount);
+
+			//Power of two bucket count with at least two buckets per quad
+			unsigned int buckets = 64;
+
+			while(buckets < 2 * quadCount)
+			{
+				buckets *= 2;
+			}
+
+			gridHead.assign(buckets, -1);
+			groupCount = 0;
+
+			for(unsigned int i = 0; i < quadCount; i++)
+			{
+				const vector<Point2f> &points = quads[i].points;
+
+				//Hole borders (dark inside) have negative area in the quad corner order
+				quadArea[i] = (float) contourArea(points, true);
+
+				float area = fabs(quadArea[i]);
+				Point2f center = (points[0] + points[1] + points[2] + points[3]) * 0.25f;
+				int level = ilogb(std::max((float) sqrt(area), 1.0f));
+				int match = -1;
+
+				uint32_t blocks = blockQuads ? quadBlocks[i] : 0;
+
+				for(int l = level - 1; l <= level + 1 && match < 0 && grouping; l++)
+				{
+					float size = ldexp(1.0f, l);
+					int x = (int) floor(center.x / size);
+					int y = (int) floor(center.y / size);
+
+					for(int k = 0; k < 9 && match < 0; k++)
+					{
+						for(int g = gridHead[gridBucket(l, x + k % 3 - 1, y + k / 3 - 1, buckets)]; g >= 0 && match < 0; g = gridNext[g])
+						{
+							unsigned int first = groupFirst[g];
+
+							//Without suppressDuplicates the nested borders found by the same block size are kept apart
+							if((suppressDuplicates || (groupBlocks[g] & blocks) == 0) && sameQuad(quads[first].points, fabs(quadArea[first]), points, area))
+							{
+								match = g;
+							}
+						}
+					}
+				}
+
+				if(match < 0)
+				{
+					match = groupCount++;
+					groupFirst[match] = i;
+					groupStart[match] = 0;
+					groupBlocks[match] = 0;
+
+					float size = ldexp(1.0f, level);
+					unsigned int bucket = gridBucket(level, (int) floor(center.x / size), (int) floor(center.y / size), buckets);
+					gridNext[match] = gridHead[bucket];
+					gridHead[bucket] = match;
+				}
+
+				quadGroup[i] = match;
+				groupStart[match]++;
+				groupBlocks[match] |= blocks;
+			}
+
+			//Counting sort of the quads by group, groupStart ends as the first position of each group
+			unsigned int position = 0;
+
+			for(unsigned int g = 0; g < groupCount; g++)
+			{
+				position += groupStart[g];
+				groupStart[g] = position;
+			}
+
+			groupStart[groupCount] = position;
+
+			for(int i = quadCount - 1; i >= 0; i--)
+			{
+				quadOrder[--groupStart[quadGroup[i]]] = i;
+			}
+
+			//Sort each group by decode preference, groups have only a few quads
+			for(unsigned int g = 0; g < groupCount; g++)
+			{
+				for(unsigned int k = groupStart[g] + 1; k < groupStart[g + 1]; k++)
+				{
+					unsigned int quad = quadOrder[k];
+					unsigned int j = k;
+
+					while(j > groupStart[g] && decodeBefore(quad, quadOrder[j - 1]))
+					{
+						quadOrder[j] = quadOrder[j - 1];
+						j--;
+					}
+
+					quadOrder[j] = quad;
+				}
+			}
+
+			trackCapacity(capacity, quadArea.capacity() + quadGroup.capacity() + quadOrder.capacity() + groupStart.capacity() + groupFirst.capacity() + groupBlocks.capacity() + gridHead.capacity() + gridNext.capacity());
+		}
+
+		/**
+		 * Check if a quad should be decoded before another quad of its group.
+		 * The border of a marker is the border of a dark region, other borders of the group are threshold rings and the quiet zone around it.
+		 * @param a Index of the first quad.
+		 * @param b Index of the second quad.
+		 * @return True if a is dark inside and b is not, or both have the same polarity and a is smaller.
+		 */
+		bool decodeBefore(unsigned int a, unsigned int b) const
+		{
+			bool darkA = quadArea[a] < 0;
+			bool darkB = quadArea[b] < 0;
+
+			if(darkA != darkB)
+			{
+				return darkA;
+			}
+
+			return fabs(quadArea[a]) < fabs(quadArea[b]);
+		}
+
+		/**
+		 * Get the spatial hash bucket of a grid cell.
+		 * @param level Size level of the cell.
+		 * @param x Cell column.
+		 * @param y Cell row.
+		 * @param buckets Number of buckets, power of two.
+		 * @return Bucket index.
+		 */
+		static unsigned int gridBucket(int level, int x, int y, unsigned int buckets)
+		{
+			return ((unsigned int) level * 73856093u ^ (unsigned int) x * 19349663u ^ (unsigned int) y * 83492791u) & (buckets - 1);
+		}
+
+		/**
+		 * Count the markers found by each block size and select the best block size as the average of the ones that found the most markers.
+		 */
+		void updateBestBlockSize()
+		{
+			unsigned int count = std::min((unsigned int) blockSizes.size(), 32u);
+
+			blockMarkers.assign(count, 0);
+
+			//A marker counts for every block size that found a quad of its group
+			for(unsigned int g = 0; g < groupCount; g++)
+			{
+				uint32_t mask = 0;
+				bool found = false;
+
+				for(unsigned int k = groupStart[g]; k < groupStart[g + 1]; k++)
+				{
+					mask |= quadBlocks[quadOrder[k]];
+					found = found || valid[quadOrder[k]];
+				}
+
+				for(unsigned int b = 0; b < count && found; b++)
+				{
+					blockMarkers[b] += (mask >> b) & 1;
+				}
+			}
+
+			unsigned int most = 0;
+			int sum = 0, best = 0;
+
+			for(unsigned int b = 0; b < count; b++)
+			{
+				if(blockMarkers[b] > most)
+				{
+					most = blockMarkers[b];
+					sum = 0;
+					best = 0;
+				}
+
+				if(blockMarkers[b] == most && most > 0)
+				{
+					sum += blockSizes[b];
+					best++;
+				}
+			}
+
+			bestBlockSize = best > 0 ? (sum / best) | 1 : thresholdBlockSize;
+		}
+
+		/**
+		 * Threshold and find quads in a list of tiles (in parallel if threads is not 1) and collect them into the detector quads.
+		 * @param list Tiles to process.
+		 * @param count Number of tiles of the list to process.
+		 */
+		void findQuads(vector<Tile> &list, unsigned int count)
+		{
+			if(threads == 1 || count == 1)
+			{
+				for(unsigned int i = 0; i < count; i++)
+				{
+					findTileQuads(list[i]);
+				}
+			}
+			else
+			{
+				parallel_for_(Range(0, count), TileLoop(this, &list), threads > 1 ? threads : -1);
+			}
+
+			mergeTiles(list, count);
+		}
+
+		/**
+		 * Collect the quads of a list of tiles into the detector quads.
+		 * Each quad is only kept by the tile that contains its center, and quads touching an inner edge of the tile are discarded because they were cut by it.
+		 * @param list Tiles to collect.
+		 * @param count Number of tiles of the list to collect.
+		 */
+		void mergeTiles(vector<Tile> &list, unsigned int count)
+		{
+			size_t capacity = quads.capacity();
+			quadCount = 0;
+			blockQuads = false;
+
+			for(unsigned int t = 0; t < count; t++)
+			{
+				Tile &tile = list[t];
+				allocations += tile.allocations;
+				squareStats.add(tile.stats);
+
+				#if ARUCO_PROFILE
+					thresholdTime += tile.thresholdTime;
+					contoursTime += tile.contoursTime;
+				#endif
+
+				for(unsigned int i = 0; i < tile.quadCount; i++)
+				{
+					vector<Point2f> &points = tile.quads[i].points;
+
+					if(!ownsQuad(tile, points))
+					{
+						continue;
+					}
+
+					if(quadCount == quads.size())
+					{
+						quads.push_back(Quadrilateral());
+					}
+
+					quads[quadCount++].points = points;
+				}
+			}
+
+			trackCapacity(capacity, quads.capacity());
+		}
+
+		/**
+		 * Check if a quad found in a tile belongs to it.
+		 * @param tile Tile where the quad was found.
+		 * @param points Quad corners in frame coordinates.
+		 * @return True if the center of the quad is in the tile core and the quad was not cut by the tile edges.
+		 */
+		bool ownsQuad(const Tile &tile, const vector<Point2f> &points)
+		{
+			Point2f center = (points[0] + points[1] + points[2] + points[3]) * 0.25f;
+
+			if(center.x < tile.core.x || center.y < tile.core.y || center.x >= tile.core.x + tile.core.width || center.y >= tile.core.y + tile.core.height)
+			{
+				return false;
+			}
+
+			for(unsigned int j = 0; j < 4; j++)
+			{
+				if((tile.rect.x > 0 && points[j].x <= tile.rect.x + 1) || (tile.rect.y > 0 && points[j].y <= tile.rect.y + 1) ||
+					(tile.rect.x + tile.rect.width < search.cols && points[j].x >= tile.rect.x + tile.rect.width - 2) ||
+					(tile.rect.y + tile.rect.height < search.rows && points[j].y >= tile.rect.y + tile.rect.height - 2))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		/**
+		 * Create the search tiles for the tracked regions, the tiles buffers are kept between frames.
+		 * Regions are stored in full resolution coordinates and are scaled down to the searched image.
+		 */
+		void updateRegions()
+		{
+			Rect bounds = Rect(0, 0, search.cols, search.rows);
+
+			regionCount = trackedRegions.size();
+
+			while(regions.size() < regionCount)
+			{
+				regions.push_back(Tile(Rect(), Rect()));
+				allocations++;
+			}
+
+			for(unsigned int i = 0; i < regionCount; i++)
+			{
+				Rect &region = trackedRegions[i];
+				Rect scaled = Rect(region.x / scale, region.y / scale, (region.width + scale - 1) / scale, (region.height + scale - 1) / scale) & bounds;
+
+				regions[i].core = scaled;
+				regions[i].rect = scaled;
+			}
+		}
+
+		/**
+		 * Check if any of the tracked markers was not found in the current markers.
+		 * @return True if a tracked marker was lost.
 		 */
-		static vector<ArucoMarker> getMarkers(Mat frame, float limitCosine = 0.7, int thresholdBlockSize = 7, int minArea = 100, double maxError = 0.025)
+		bool lostTracked()
 		{
-			//Create a grayscale image
-			Mat gray;
-			cvtColor(frame, gray, COLOR_BGR2GRAY);
+			for(unsigned int i = 0; i < trackedIds.size(); i++)
+			{
+				bool found = false;
 
-			//Adaptive threshold
-			Mat thresh;
-			adaptiveThreshold(gray, thresh, 255, THRESH_BINARY, ADAPTIVE_THRESH_MEAN_C, thresholdBlockSize, 0.0);
+				for(unsigned int j = 0; j < markers.size() && !found; j++)
+				{
+					found = markers[j].id == trackedIds[i];
+				}
 
-			#if DEBUG
-				imshow("Adaptive", thresh);
-			#endif
+				if(!found)
+				{
+					return true;
+				}
+			}
 
-			//Get quads
-			vector<Quadrilateral> quads = SquareFinder::findSquares(thresh, limitCosine, minArea, maxError);
+			return false;
+		}
 
-			#if DEBUG
-				Mat quad = frame.clone();
-				SquareFinder::drawQuads(quad, quads);
-				imshow("Quads", quad);
+		/**
+		 * Store the ids and search regions of the markers found in the current frame.
+		 * Each region is the marker bounding box expanded by the tracking margin, overlapping regions are merged so no area is searched twice.
+		 */
+		void updateTracked()
+		{
+			size_t capacity = trackedRegions.capacity() + trackedIds.capacity();
+			Rect frame = Rect(0, 0, gray.cols, gray.rows);
+
+			trackedRegions.clear();
+			trackedIds.clear();
+
+			for(unsigned int i = 0; i < markers.size(); i++)
+			{
+				Rect box = boundingRect(markers[i].projected);
+				int margin = (int)(trackingMargin * std::max(box.width, box.height)) + thresholdBlockSize;
+
+				trackedIds.push_back(markers[i].id);
+				trackedRegions.push_back(Rect(box.x - margin, box.y - margin, box.width + 2 * margin, box.height + 2 * margin) & frame);
+			}
+
+			//Merge overlapping regions until none changes, a grown region can overlap a region checked before it
+			bool merged = true;
+
+			while(merged)
+			{
+				merged = false;
+
+				for(unsigned int i = 0; i < trackedRegions.size(); i++)
+				{
+					for(unsigned int j = i + 1; j < trackedRegions.size(); j++)
+					{
+						if((trackedRegions[i] & trackedRegions[j]).area() > 0)
+						{
+							trackedRegions[i] |= trackedRegions[j];
+							trackedRegions.erase(trackedRegions.begin() + j);
+							j = i;
+							merged = true;
+						}
+					}
+				}
+			}
+
+			trackCapacity(capacity, trackedRegions.capacity() + trackedIds.capacity());
+		}
+
+		/**
+		 * Parallel loop body used to process tiles across threads.
+		 */
+		class TileLoop : public ParallelLoopBody
+		{
+			public:
+				ArucoDetector *detector;
+				vector<Tile> *list;
+
+				TileLoop(ArucoDetector *_detector, vector<Tile> *_list)
+				{
+					detector = _detector;
+					list = _list;
+				}
+
+				void operator()(const Range &range) const
+				{
+					for(int i = range.start; i < range.end; i++)
+					{
+						detector->findTileQuads((*list)[i]);
+					}
+				}
+		};
+
+		/**
+		 * Group the quads found in the frame, decode one quad of each group and store the valid ones in the markers vector.
+		 * Candidates are decoded into their own slots (in parallel if threads is not 1) and collected in group order, so the output order does not depend on the number of threads.
+		 * The grayscale buffer should already be filled.
+		 * @return Number of valid markers.
+		 */
+		unsigned int decodeQuads()
+		{
+			#if ARUCO_PROFILE
+				double time = StageTimer::now();
 			#endif
 
-			//List of markers
-			vector<ArucoMarker> markers = vector<ArucoMarker>();
+			groupQuads();
 
-			//Transform quads and filter invalid markers
-			for(unsigned int i = 0; i < quads.size(); i++)
+			size_t capacity = candidates.capacity() + valid.capacity() + markers.capacity();
+
+			if(candidates.size() < quadCount)
 			{
+				candidates.resize(quadCount, blank);
+				valid.resize(quadCount);
+			}
 
-				Mat board = deformQuad(frame, Point2i(49, 49), quads[i].points);
-				Mat binary = processArucoImage(board);
+			if(threads == 1 || groupCount < 2)
+			{
+				const uchar *previousBoard = board.data;
+				const uchar *previousCells = cells.data;
+				const uchar *previousBinary = binary.data;
 
-				//Process aruco image and get data
-				ArucoMarker marker = readArucoData(binary);
-				marker.projected = quads[i].points;
+				decodeCandidates(0, groupCount, board, cells, cellsGray, binary);
 
-				//Check if marker is valid
-				if(marker.validate())
-				{					
-					//Show board
-					#if DEBUG
-						imshow("Board", board);
-					#endif
+				trackBuffer(board, previousBoard);
+				trackBuffer(cells, previousCells);
+				trackBuffer(binary, previousBinary);
+			}
+			else
+			{
+				unsigned int count = std::min((unsigned int) (threads > 1 ? threads : getNumThreads()), groupCount);
+
+				while(stripes.size() < count)
+				{
+					stripes.push_back(DecodeStripe());
+					allocations++;
+				}
+
+				parallel_for_(Range(0, count), DecodeLoop(this, count), count);
 
-					markers.push_back(marker);
+				for(unsigned int s = 0; s < count; s++)
+				{
+					allocations += stripes[s].allocations;
 				}
 			}
 
-			return markers;
+			//Collect the valid candidate of each group keeping the group order, and count the quads decoded until it
+			unsigned int count = 0;
+
+			for(unsigned int g = 0; g < groupCount; g++)
+			{
+				for(unsigned int k = groupStart[g]; k < groupStart[g + 1]; k++)
+				{
+					unsigned int i = quadOrder[k];
+					candidateCount++;
+
+					if(valid[i])
+					{
+						if(count == markers.size())
+						{
+							markers.push_back(blank);
+						}
+
+						markers[count++] = candidates[i];
+						break;
+					}
+				}
+			}
+
+			markers.resize(count);
+			trackCapacity(capacity, candidates.capacity() + valid.capacity() + markers.capacity());
+
+			#if ARUCO_PROFILE
+				decodeTime += StageTimer::now() - time;
+			#endif
+
+			return count;
+		}
+
+		/**
+		 * Decode and validate the quads of a range of groups from the grayscale image, each candidate is written into its own slot.
+		 * The quads of a group are decoded in order until one is valid, the rest are left invalid.
+		 * @param start First group.
+		 * @param end Last group (exclusive).
+		 * @param board Buffer for the warped board (only used when not sampling cells).
+		 * @param cells Buffer for the resampled board.
+		 * @param cellsGray Buffer for the grayscale resampled board.
+		 * @param binary Buffer for the binary resampled board.
+		 */
+		void decodeCandidates(int start, int end, Mat &board, Mat &cells, Mat &cellsGray, Mat &binary)
+		{
+			for(int k = groupStart[start]; k < (int) groupStart[end]; k++)
+			{
+				valid[quadOrder[k]] = false;
+			}
+
+			for(int g = start; g < end; g++)
+			{
+				for(unsigned int k = groupStart[g]; k < groupStart[g + 1]; k++)
+				{
+					if(decodeCandidate(quadOrder[k], board, cells, cellsGray, binary))
+					{
+						break;
+					}
+				}
+			}
+		}
+
+		/**
+		 * Decode and validate a candidate from the grayscale image into its slot.
+		 * @param i Index of the quad.
+		 * @param board Buffer for the warped board (only used when not sampling cells).
+		 * @param cells Buffer for the resampled board.
+		 * @param cellsGray Buffer for the grayscale resampled board.
+		 * @param binary Buffer for the binary resampled board.
+		 * @return True if the candidate is a valid marker.
+		 */
+		bool decodeCandidate(unsigned int i, Mat &board, Mat &cells, Mat &cellsGray, Mat &binary)
+		{
+			ArucoMarker &marker = candidates[i];
+			marker = blank;
+
+			if(sampleCells)
+			{
+				sampleArucoData(gray, quads[i].points, marker, cellSamples);
+			}
+			else
+			{
+				deformQuad(gray, board, boardCorners, quads[i].points);
+				processArucoImage(board, cells, cellsGray, binary);
+				readArucoData(binary, marker);
+			}
+
+			marker.projected = quads[i].points;
+
+			//Check if marker is valid
+			valid[i] = marker.validate();
+
+			return valid[i];
+		}
+
+		/**
+		 * Parallel loop body used to decode candidates across threads.
+		 * The groups are split in one range per stripe, each stripe uses its own board buffers kept by the detector.
+		 */
+		class DecodeLoop : public ParallelLoopBody
+		{
+			public:
+				ArucoDetector *detector;
+				unsigned int count;
+
+				DecodeLoop(ArucoDetector *_detector, unsigned int _count)
+				{
+					detector = _detector;
+					count = _count;
+				}
+
+				void operator()(const Range &range) const
+				{
+					for(int s = range.start; s < range.end; s++)
+					{
+						DecodeStripe &stripe = detector->stripes[s];
+						const uchar *previousBoard = stripe.board.data;
+						const uchar *previousCells = stripe.cells.data;
+						const uchar *previousBinary = stripe.binary.data;
+
+						int start = (int) ((unsigned long) detector->groupCount * s / count);
+						int end = (int) ((unsigned long) detector->groupCount * (s + 1) / count);
+
+						detector->decodeCandidates(start, end, stripe.board, stripe.cells, stripe.cellsGray, stripe.binary);
+
+						stripe.allocations = (stripe.board.data != previousBoard) + (stripe.cells.data != previousCells) + (stripe.binary.data != previousBinary);
+					}
+				}
+		};
+
+		/**
+		 * Process image to identify aruco markers.
+		 * Applies pre-processing over the frame and get list of quads in the frame.
+		 * Creates a temporary detector, use a ArucoDetector instance to reuse buffers between frames.
+		 * @param frame Frame to be processed.
+		 * @param limitCosine Higher values allow detection of more distorted markers but performance is slower
+		 * @param decimation Factor used to downscale the image before searching quads, 0 selects it from minArea.
+		 */
+		static vector<ArucoMarker> getMarkers(Mat frame, float limitCosine = 0.7, int thresholdBlockSize = 7, int minArea = 100, double maxError = 0.025, int decimation = 1)
+		{
+			ArucoDetector detector = ArucoDetector(limitCosine, thresholdBlockSize, minArea, maxError);
+			detector.decimation = decimation;
+			return detector.detect(frame);
 		}
 
 		/**
@@ -92,16 +1581,32 @@ class ArucoDetector
 		 */
 		static Mat processArucoImage(Mat image)
 		{
-			Mat aruco;
-			resize(image, aruco, Size(7, 7));
+			Mat aruco, gray, binary;
+			processArucoImage(image, aruco, gray, binary);
+			return binary;
+		}
 
-			Mat gray;
-			cvtColor(aruco, gray, CV_RGB2GRAY);
+		/**
+		 * Get aruco marker bits data writing into buffers provided by the caller.
+		 * @param image Square image with the aruco marker, grayscale or color.
+		 * @param aruco Resampled 7x7 image.
+		 * @param gray Grayscale version of the resampled image, shares the resampled image if it is already grayscale.
+		 * @param binary Output binary image with the aruco code.
+		 */
+		static void processArucoImage(Mat image, Mat &aruco, Mat &gray, Mat &binary)
+		{
+			resize(image, aruco, Size(7, 7));
 
-			Mat binary;
-			threshold(gray, binary, 0, 255, CV_THRESH_BINARY | CV_THRESH_OTSU);;
+			if(aruco.channels() == 1)
+			{
+				gray = aruco;
+			}
+			else
+			{
+				cvtColor(aruco, gray, CV_RGB2GRAY);
+			}
 
-			return binary;
+			threshold(gray, binary, 0, 255, CV_THRESH_BINARY | CV_THRESH_OTSU);
 		}
 
 		/**
@@ -112,13 +1617,219 @@ class ArucoDetector
 		static ArucoMarker readArucoData(Mat binary)
 		{
 			ArucoMarker marker = ArucoMarker();
+			readArucoData(binary, marker);
+			return marker;
+		}
+
+		/**
+		 * Read aruco data from binary image into an existing marker.
+		 * @param binary Binary image containing aruco info.
+		 * @param marker Marker where the cells are written.
+		 */
+		static void readArucoData(Mat binary, ArucoMarker &marker)
+		{
+			marker.cells = 0;
 
 			for(unsigned int i = 0; i < binary.cols * binary.rows ; i++)
 			{
-				marker.cells[i / binary.cols][i % binary.cols] = (binary.data[i] == 255);
+				if(binary.data[i] == 255)
+				{
+					marker.cells |= (uint64_t) 1 << i;
+				}
+			}
+		}
+
+		/**
+		 * Read aruco data by sampling the cells directly from the grayscale image.
+		 * The homography from the unit square to the quad is calculated once and used to sample the center of each one of the 7x7 cells.
+		 * Cell values are binarized using Otsu's method, same as done for the warped board.
+		 * @param gray Grayscale image.
+		 * @param quad Corners of the marker candidate.
+		 * @param marker Marker where the cells are written.
+		 * @param samples Number of samples per cell on each axis, taken from the center half of the cell.
+		 */
+		static void sampleArucoData(const Mat &gray, const vector<Point2f> &quad, ArucoMarker &marker, int samples = 1)
+		{
+			//Homography from the unit square to the quad (u along the first edge, v along the last edge)
+			float x0 = quad[0].x, y0 = quad[0].y;
+			float x1 = quad[1].x, y1 = quad[1].y;
+			float x2 = quad[2].x, y2 = quad[2].y;
+			float x3 = quad[3].x, y3 = quad[3].y;
+
+			float sx = x0 - x1 + x2 - x3;
+			float sy = y0 - y1 + y2 - y3;
+			float g = 0, h = 0;
+
+			if(sx != 0 || sy != 0)
+			{
+				float dx1 = x1 - x2, dx2 = x3 - x2;
+				float dy1 = y1 - y2, dy2 = y3 - y2;
+				float den = dx1 * dy2 - dx2 * dy1;
+
+				if(den != 0)
+				{
+					g = (sx * dy2 - dx2 * sy) / den;
+					h = (dx1 * sy - sx * dy1) / den;
+				}
 			}
 
-			return marker;
+			float a = x1 - x0 + g * x1, b = x3 - x0 + h * x3;
+			float d = y1 - y0 + g * y1, e = y3 - y0 + h * y3;
+
+			//Sample cells
+			float values[49];
+			float step = 0.5f / samples;
+
+			for(int i = 0; i < 7; i++)
+			{
+				for(int j = 0; j < 7; j++)
+				{
+					float sum = 0;
+
+					for(int k = 0; k < samples; k++)
+					{
+						float u = (i + 0.25f + step * (k + 0.5f)) / 7.0f;
+
+						for(int l = 0; l < samples; l++)
+						{
+							float v = (j + 0.25f + step * (l + 0.5f)) / 7.0f;
+							float w = g * u + h * v + 1.0f;
+
+							sum += sampleBilinear(gray, (a * u + b * v + x0) / w, (d * u + e * v + y0) / w);
+						}
+					}
+
+					values[i * 7 + j] = sum / (samples * samples);
+				}
+			}
+
+			//Binarize cells
+			float level = otsuThreshold(values);
+
+			marker.cells = 0;
+
+			for(int i = 0; i < 49; i++)
+			{
+				if(values[i] > level)
+				{
+					marker.cells |= (uint64_t) 1 << i;
+				}
+			}
+		}
+
+		/**
+		 * Sample a grayscale image using bilinear interpolation.
+		 * Coordinates outside of the image are clamped to the image border.
+		 * @param gray Grayscale image.
+		 * @param x X coordinate.
+		 * @param y Y coordinate.
+		 * @return Interpolated value.
+		 */
+		static float sampleBilinear(const Mat &gray, float x, float y)
+		{
+			x = std::min(std::max(x, 0.0f), (float)(gray.cols - 1));
+			y = std::min(std::max(y, 0.0f), (float)(gray.rows - 1));
+
+			int ix = (int) x, iy = (int) y;
+			int jx = std::min(ix + 1, gray.cols - 1), jy = std::min(iy + 1, gray.rows - 1);
+			float fx = x - ix, fy = y - iy;
+
+			const uchar *a = gray.ptr<uchar>(iy);
+			const uchar *b = gray.ptr<uchar>(jy);
+
+			float top = a[ix] + (a[jx] - a[ix]) * fx;
+			float bottom = b[ix] + (b[jx] - b[ix]) * fx;
+
+			return top + (bottom - top) * fy;
+		}
+
+		/**
+		 * Calculate Otsu's threshold for the 49 cell values of a marker.
+		 * Values above the returned threshold are considered white.
+		 * @param values Cell values.
+		 * @return Threshold value.
+		 */
+		static float otsuThreshold(const float values[49])
+		{
+			float sorted[49];
+			float total = 0;
+
+			for(int i = 0; i < 49; i++)
+			{
+				sorted[i] = values[i];
+				total += values[i];
+			}
+
+			std::sort(sorted, sorted + 49);
+
+			//If there is no valid split all cells are black
+			float level = sorted[48];
+			float best = -1, sum = 0;
+
+			for(int k = 1; k < 49; k++)
+			{
+				sum += sorted[k - 1];
+
+				if(sorted[k - 1] == sorted[k])
+				{
+					continue;
+				}
+
+				float mean0 = sum / k;
+				float mean1 = (total - sum) / (49 - k);
+				float variance = k * (49 - k) * (mean0 - mean1) * (mean0 - mean1);
+
+				if(variance > best)
+				{
+					best = variance;
+					level = sorted[k - 1];
+				}
+			}
+
+			return level;
+		}
+
+		/**
+		 * Count a buffer allocation if the data pointer of the mat changed.
+		 * @param mat Mat after being written.
+		 * @param previous Data pointer of the mat before being written.
+		 */
+		void trackBuffer(const Mat &mat, const uchar *previous)
+		{
+			if(mat.data != previous)
+			{
+				allocations++;
+			}
+		}
+
+		/**
+		 * Count a buffer allocation if the capacity of the buffers grew.
+		 * @param previous Capacity before the buffers were written.
+		 * @param current Capacity after the buffers were written.
+		 */
+		void trackCapacity(size_t previous, size_t current)
+		{
+			if(current != previous)
+			{
+				allocations++;
+			}
+		}
+
+		/**
+		 * Sum of the capacity of all the inner vectors.
+		 * @param vectors Vector of vectors.
+		 * @return Total capacity.
+		 */
+		static size_t innerCapacity(const vector<vector<Point>> &vectors)
+		{
+			size_t capacity = 0;
+
+			for(unsigned int i = 0; i < vectors.size(); i++)
+			{
+				capacity += vectors[i].capacity();
+			}
+
+			return capacity;
 		}
 
 		/**
@@ -148,11 +1859,14 @@ class ArucoDetector
 				//Draw referencial
 				Mat rotation, position;
 
-				#if CV_MAJOR_VERSION == 2
-					solvePnP(markers[i].info.world, markers[i].projected, camera, distortion, rotation, position, false, ITERATIVE);
-				#else
-					solvePnP(markers[i].info.world, markers[i].projected, camera, distortion, rotation, position, false, SOLVEPNP_ITERATIVE);
-				#endif
+				if(!PoseEstimator::solveSquare(markers[i].info.world, markers[i].projected, camera, distortion, rotation, position))
+				{
+					#if CV_MAJOR_VERSION == 2
+						solvePnP(markers[i].info.world, markers[i].projected, camera, distortion, rotation, position, false, ITERATIVE);
+					#else
+						solvePnP(markers[i].info.world, markers[i].projected, camera, distortion, rotation, position, false, SOLVEPNP_ITERATIVE);
+					#endif
+				}
 				
 				vector<Point3d> referencial;
 				referencial.push_back(Point3d(0, 0, 0));
@@ -202,22 +1916,35 @@ class ArucoDetector
 					world.push_back(markers[i].info.world[k]);
 					image.push_back(markers[i].projected[k]);
 				}
+			}
 
-				//Draw countours
+			PoseEstimator estimator = PoseEstimator(false);
+			estimator.solve(world, image, camera, distortion);
+
+			drawOrigin(frame, markers, camera, distortion, estimator.rotation, estimator.position, size);
+		}
+
+		/**
+		 * Draw origin of the referencial from a pose already estimated.
+		 * @param frame Image where to write origin referencial.
+		 * @param markers Vector with all aruco markers used to estimate the pose.
+		 * @param camera Camera intrinsic calibration matrix.
+		 * @param distortion Camera distortion calibration matrix.
+		 * @param rotation Rotation (Rodrigues) of the world relative to the camera.
+		 * @param position Translation of the world relative to the camera.
+		 * @param size Size of the referencial.
+		 */
+		static void drawOrigin(Mat frame, const vector<ArucoMarker> &markers, Mat camera, Mat distortion, Mat rotation, Mat position, float size = 1)
+		{
+			//Draw countours
+			for(unsigned int i = 0; i < markers.size(); i++)
+			{
 				for(unsigned int j = 0; j < 4; j++)
 				{
 					line(frame, markers[i].projected[j], markers[i].projected[(j + 1) % 4], Scalar(0, 150, 0), 2);
 				}
 			}
 
-			Mat rotation, position;
-
-			#if CV_MAJOR_VERSION == 2
-				solvePnP(world, image, camera, distortion, rotation, position, false, ITERATIVE);
-			#else
-				solvePnP(world, image, camera, distortion, rotation, position, false, SOLVEPNP_ITERATIVE);
-			#endif
-
 			vector<Point3d> referencial;
 			referencial.push_back(Point3d(0, 0, 0));
 			referencial.push_back(Point3d(size, 0, 0));
@@ -246,7 +1973,7 @@ class ArucoDetector
 		 */
 		static Mat previewQuads(Mat frame, vector<Quadrilateral> quads)
 		{
-			Mat sum = Mat::zeros(frame.rows, frame.cols, CV_8UC3);
+			Mat sum = Mat::zeros(frame.rows, frame.cols, frame.type());
 
 			for(unsigned int i = 0; i < quads.size(); i++)
 			{
@@ -270,7 +1997,7 @@ class ArucoDetector
 			{
 				for(unsigned int j = 0; j < 7; j++)
 				{
-					out.data[i * 7 + j] = marker.cells[i][j] * 255;
+					out.data[i * 7 + j] = marker.getCell(i, j) * 255;
 				}
 			}
 
@@ -288,7 +2015,7 @@ class ArucoDetector
 		 */
 		static Mat filterQuadRegion(Mat image, Quadrilateral quad)
 		{
-			Mat out = Mat::zeros(image.rows, image.cols, CV_8UC3);
+			Mat out = Mat::zeros(image.rows, image.cols, image.type());
 
 			Point p[1][4];
 			p[0][0] = quad.points[0];
@@ -300,17 +2027,21 @@ class ArucoDetector
 			int points_count[] = {4};
 
 			//Create Mask
-			fillPoly(out, points, points_count, 1, Scalar(1, 1, 1));
+			fillPoly(out, points, points_count, 1, Scalar(1, 1, 1, 1));
 
 			//Apply mask to image
+			unsigned int channels = out.channels();
+
 			for(unsigned int i = 0; i < out.rows; i++)
 			{
 				for(unsigned int j = 0; j < out.cols; j++)
 				{
-					int t = (i*out.cols+j)*3;
-					out.data[t] *= image.data[t];
-					out.data[t+1] *= image.data[t+1];
-					out.data[t+2] *= image.data[t+2];
+					int t = (i*out.cols+j)*channels;
+
+					for(unsigned int c = 0; c < channels; c++)
+					{
+						out.data[t+c] *= image.data[t+c];
+					}
 				}
 			}
 
@@ -326,7 +2057,7 @@ class ArucoDetector
 		 */
 		static Mat deformQuad(Mat image, Point2i size, vector<Point2f> quad)
 		{
-			Mat out = Mat::zeros(size.x, size.y, CV_8UC3);
+			Mat out = Mat::zeros(size.x, size.y, image.type());
 
 			vector<Point2f> points;
 			points.push_back(Point2f(0, 0));
@@ -334,9 +2065,21 @@ class ArucoDetector
 			points.push_back(Point2f(out.cols, out.rows));
 			points.push_back(Point2f(out.cols, 0));
 
-			Mat transformation = getPerspectiveTransform(quad, points);
-			warpPerspective(image, out, transformation, out.size(), INTER_LINEAR);
+			deformQuad(image, out, points, quad);
 
 			return out;
 		}
+
+		/**
+		 * Apply inverse perspective transformation to image using quad writing into an existing mat.
+		 * @param image Image to transform.
+		 * @param out Output image, its size is defined by the corners.
+		 * @param corners Corners of the output image in the same order as the quad points.
+		 * @param quad Quad that defines the square area.
+		 */
+		static void deformQuad(Mat image, Mat &out, const vector<Point2f> &corners, const vector<Point2f> &quad)
+		{
+			Mat transformation = getPerspectiveTransform(quad, corners);
+			warpPerspective(image, out, transformation, Size((int) corners[2].x, (int) corners[2].y), INTER_LINEAR);
+		}
 };
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Lookup table for the 5x5 aruco dictionary generated at compile time.
+ * The payload of a marker is the 5x5 data area packed as 25 bits, the cell (i, j) of the data area is stored in the bit i * 5 + j.
+ * Every one of the 1024 ids is stored for its 4 rotations, so a sampled payload is decoded into id and rotation with a single hash lookup.
+ */
+class ArucoDictionary
+{
+	public:
+		/**
+		 * Result of a dictionary lookup.
+		 */
+		struct Match
+		{
+			/**
+			 * Id of the marker, -1 if the payload is not part of the dictionary.
+			 */
+			int id;
+
+			/**
+			 * Number of 90 degrees turns that have to be applied to the payload to read the id.
+			 */
+			int rotation;
+
+			/**
+			 * Minimum hamming distance to the signature rows over the 4 rotations, 0 if the payload is valid.
+			 */
+			int distance;
+		};
+
+		/**
+		 * Number of slots in the hash table, the table holds 4096 payloads so the load factor is 0.5.
+		 */
+		static constexpr int SLOTS = 8192;
+
+		/**
+		 * Hash table entry, key stores the payload + 1 (0 is an empty slot).
+		 */
+		struct Entry
+		{
+			uint32_t key;
+			int16_t id;
+			int16_t rotation;
+		};
+
+		/**
+		 * Tables generated at compile time.
+		 */
+		struct Tables
+		{
+			/**
+			 * Open addressing hash table from payload to id and rotation.
+			 */
+			Entry entries[SLOTS];
+
+			/**
+			 * Minimum hamming distance of each 5 bit row to the signature rows.
+			 */
+			uint8_t rowDistance[32];
+
+			/**
+			 * Rotation of the payload by bytes, each entry stores the rotated bits of a byte value.
+			 */
+			uint32_t rotation[4][256];
+		};
+
+		/**
+		 * Decode a payload into id, rotation and distance.
+		 * @param payload 25 bit payload.
+		 * @return Match for the payload.
+		 */
+		static Match lookup(uint32_t payload)
+		{
+			const Tables &t = tables();
+
+			Match match;
+			match.id = -1;
+			match.rotation = 0;
+			match.distance = 0;
+
+			for(uint32_t slot = hash(payload); t.entries[slot].key != 0; slot = (slot + 1) & (SLOTS - 1))
+			{
+				if(t.entries[slot].key == payload + 1)
+				{
+					match.id = t.entries[slot].id;
+					match.rotation = t.entries[slot].rotation;
+					return match;
+				}
+			}
+
+			//Invalid payload get the distance to the closest rotation
+			match.distance = 25;
+
+			for(int r = 0; r < 4; r++)
+			{
+				int distance = 0;
+
+				for(int i = 0; i < 5; i++)
+				{
+					distance += t.rowDistance[(payload >> (i * 5)) & 0x1F];
+				}
+
+				if(distance < match.distance)
+				{
+					match.distance = distance;
+				}
+
+				payload = t.rotation[0][payload & 0xFF] | t.rotation[1][(payload >> 8) & 0xFF] | t.rotation[2][(payload >> 16) & 0xFF] | t.rotation[3][(payload >> 24) & 0xFF];
+			}
+
+			return match;
+		}
+
+		/**
+		 * Signature rows used to validate the aruco markers, the bit k stores the data cell k of the row.
+		 * @param value Two bit value encoded by the row.
+		 * @return Signature row bits.
+		 */
+		static constexpr uint32_t signature(int value)
+		{
+			return value == 0 ? 0x01 : value == 1 ? 0x1D : value == 2 ? 0x12 : 0x0E;
+		}
+
+		/**
+		 * Payload of a marker id in its canonical rotation.
+		 * @param id Marker id.
+		 * @return Payload bits.
+		 */
+		static constexpr uint32_t encode(int id)
+		{
+			uint32_t payload = 0;
+
+			for(int i = 0; i < 5; i++)
+			{
+				payload |= signature((id >> (2 * (4 - i))) & 3) << (i * 5);
+			}
+
+			return payload;
+		}
+
+		/**
+		 * Rotate a payload 90 degrees, cell (i, j) is moved to (j, 4 - i) same as ArucoMarker::rotate.
+		 * @param payload Payload bits.
+		 * @return Rotated payload.
+		 */
+		static constexpr uint32_t rotate(uint32_t payload)
+		{
+			uint32_t out = 0;
+
+			for(int b = 0; b < 25; b++)
+			{
+				if((payload >> b) & 1)
+				{
+					out |= (uint32_t) 1 << ((b % 5) * 5 + 4 - b / 5);
+				}
+			}
+
+			return out;
+		}
+
+		/**
+		 * Hash slot of a payload.
+		 * @param payload Payload bits.
+		 * @return Slot index.
+		 */
+		static constexpr uint32_t hash(uint32_t payload)
+		{
+			return ((payload * 2654435761u) >> 19) & (SLOTS - 1);
+		}
+
+		/**
+		 * Generate the lookup tables.
+		 * Payloads are inserted by increasing rotation so a payload that matches more than one rotation keeps the first one, as the rotate and retry validation did.
+		 * @return Tables.
+		 */
+		static constexpr Tables build()
+		{
+			Tables t = {};
+
+			for(int r = 0; r < 4; r++)
+			{
+				for(int id = 0; id < 1024; id++)
+				{
+					//Payload that after r rotations reads the id
+					uint32_t payload = encode(id);
+
+					for(int k = 0; k < (4 - r) % 4; k++)
+					{
+						payload = rotate(payload);
+					}
+
+					uint32_t slot = hash(payload);
+
+					while(t.entries[slot].key != 0 && t.entries[slot].key != payload + 1)
+					{
+						slot = (slot + 1) & (SLOTS - 1);
+					}
+
+					if(t.entries[slot].key == 0)
+					{
+						t.entries[slot].key = payload + 1;
+						t.entries[slot].id = (int16_t) id;
+						t.entries[slot].rotation = (int16_t) r;
+					}
+				}
+			}
+
+			for(uint32_t row = 0; row < 32; row++)
+			{
+				uint8_t best = 5;
+
+				for(int value = 0; value < 4; value++)
+				{
+					uint32_t diff = row ^ signature(value);
+					uint8_t count = 0;
+
+					for(int b = 0; b < 5; b++)
+					{
+						count += (diff >> b) & 1;
+					}
+
+					if(count < best)
+					{
+						best = count;
+					}
+				}
+
+				t.rowDistance[row] = best;
+			}
+
+			for(int k = 0; k < 4; k++)
+			{
+				for(uint32_t value = 0; value < 256; value++)
+				{
+					uint32_t bits = (value << (8 * k)) & 0x1FFFFFF;
+					t.rotation[k][value] = rotate(bits);
+				}
+			}
+
+			return t;
+		}
+
+		/**
+		 * Get the compile time generated tables.
+		 * @return Dictionary tables.
+		 */
+		static const Tables &tables()
+		{
+			static constexpr Tables t = build();
+			return t;
+		}
+};
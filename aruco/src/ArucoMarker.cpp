@@ -3,10 +3,12 @@
 #include <string>
 #include <iostream>
 #include <math.h>
+#include <stdint.h>
 
 #include <opencv2/core/core.hpp>
 
 #include "ArucoMarkerInfo.cpp"
+#include "ArucoDictionary.cpp"
 
 using namespace cv;
 using namespace std;
@@ -19,10 +21,10 @@ class ArucoMarker
 {
 	public:
 		/**
-		 * Contain all the cells in the marker.
-		 * Cells are encoded as [x][y] from left to right on X and from up to down on Y.
+		 * Contain all the 7x7 cells in the marker packed as bits, 1 for white cells.
+		 * Cell (i, j) is stored in the bit i * 7 + j, rows from up to down and cols from left to right.
 		 */
-		int cells[7][7];
+		uint64_t cells;
 
 		/**
 		 * Number of rows used to store data in the marker.
@@ -69,23 +71,50 @@ class ArucoMarker
 		{
 			rows = 5;
 			cols = 5;
+			cells = 0;
 			id = -1;
 			rotation = 0;
 			validated = false;
 		}
 
+		/**
+		 * Get the value of a cell.
+		 *
+		 * @param i Row of the cell.
+		 * @param j Col of the cell.
+		 * @return 1 if the cell is white, 0 otherwise.
+		 */
+		int getCell(int i, int j) const
+		{
+			return (cells >> (i * 7 + j)) & 1;
+		}
+
+		/**
+		 * Set the value of a cell.
+		 *
+		 * @param i Row of the cell.
+		 * @param j Col of the cell.
+		 * @param value Non zero for white cells.
+		 */
+		void setCell(int i, int j, int value)
+		{
+			uint64_t bit = (uint64_t) 1 << (i * 7 + j);
+			cells = value ? (cells | bit) : (cells & ~bit);
+		}
+
 		/**
 		 * Attach info to this marker.
 		 *
 		 * @param info Marker information.
 		 */
-		void attachInfo(ArucoMarkerInfo _info)
+		void attachInfo(const ArucoMarkerInfo &_info)
 		{
 			info = _info;
 		}
 
 		/**
 		 * Get the id of the marker. The ID its a value between 0 and 1024.
+		 * Each data row stores two bits of the ID in the cells 2 and 4.
 		 *
 		 * @return ID of this aruco marker.
 		 */
@@ -95,15 +124,31 @@ class ArucoMarker
 
 			for(int i = 1; i < 6; ++i)
 			{
-				id <<= 1;
-				id |= cells[i][2];
-				id <<= 1;
-				id |= cells[i][4];
+				int row = (int)(cells >> (i * 7)) & 0x7F;
+				id = (id << 2) | (((row >> 2) & 1) << 1) | ((row >> 4) & 1);
 			}
 
 			return id;
 		}
 
+		/**
+		 * Fill the marker cells with the code of an ID, inverse of calculateID.
+		 * The border cells are set to black and each data row is set to the signature row of its two bits.
+		 *
+		 * @param _id ID of the marker between 0 and 1024.
+		 */
+		void encodeID(int _id)
+		{
+			id = _id;
+			cells = 0;
+
+			for(int i = 1; i < 6; i++)
+			{
+				uint64_t row = signature((_id >> (2 * (5 - i))) & 3);
+				cells |= row << (i * 7 + 1);
+			}
+		}
+
 		/**
 		 * Calculate all parameters and check if its a valid aruco marker.
 		 * Should be called only after projected points and cell info is added.
@@ -120,59 +165,53 @@ class ArucoMarker
 			}
 
 			//Check black border allow up to three white squares for edge light bleed cases
-			unsigned int bad = 0;
-			for(unsigned int i = 0; i < 7; i++)
+			if(popcount(borderBits(cells)) > 3)
 			{
-				if(cells[i][0] != 0 || cells[i][6] != 0 || cells[0][i] != 0 || cells[6][i] != 0)
-				{
-					bad++;
-					if(bad > 3)
-					{
-						return false;
-					}
-				}
+				return false;
 			}
 
-			//Check hamming distance of internal data
-			for(int j = 0; j < 4; j++)
+			//Decode id and rotation from the dictionary
+			ArucoDictionary::Match match = ArucoDictionary::lookup(payload());
+
+			if(match.id < 0)
 			{
-				if(hammingDistance() == 0)
-				{
-					calculateID();
-					validated = true;
-					return true;
-				}
+				return false;
+			}
 
+			for(int j = 0; j < match.rotation; j++)
+			{
 				rotate();
 			}
 
-			return false;
+			id = match.id;
+			validated = true;
+			return true;
 		}
 
 		/**
-		 * Used to rotate marker 90 degrees.
-		 * Can be used to rotate the marker data and make sure that it is read properly.
+		 * Get the 5x5 data area of the marker packed as 25 bits, cell (i, j) of the data area is stored in the bit i * 5 + j.
+		 *
+		 * @return Payload bits.
 		 */
-		void rotate()
+		uint32_t payload() const
 		{
-			int temp[7][7];
-			int n = 7;
+			uint32_t bits = 0;
 
-			for (int i = 0; i < n; i++)
+			for(int i = 0; i < 5; i++)
 			{
-				for (int j = 0; j < n; j++)
-				{
-					temp[i][j] = cells[n - j - 1][i];
-				}
+				bits |= (uint32_t)((cells >> ((i + 1) * 7 + 1)) & 0x1F) << (i * 5);
 			}
 
-			for (int i = 0; i < n; i++)
-			{
-				for (int j = 0; j < n; j++)
-				{
-					cells[i][j] = temp[i][j];
-				}
-			}
+			return bits;
+		}
+
+		/**
+		 * Used to rotate marker 90 degrees.
+		 * Can be used to rotate the marker data and make sure that it is read properly.
+		 */
+		void rotate()
+		{
+			cells = rotateBits(cells);
 
 			rotation++;
 
@@ -184,28 +223,16 @@ class ArucoMarker
 		 */
 		int hammingDistance()
 		{
-			int ids[4][5] = {
-				{1, 0, 0, 0, 0},
-				{1, 0, 1, 1, 1},
-				{0, 1, 0, 0, 1},
-				{0, 1, 1, 1, 0}
-			};
-
 			int dist = 0;
-			int sum, minSum;
 
 			for(int i = 1; i < 6; ++i)
 			{
-				minSum = 99999;
+				uint64_t row = (cells >> (i * 7 + 1)) & 0x1F;
+				int minSum = 5;
 
-				for(int j = 1; j < 5; ++j)
+				for(int j = 0; j < 4; ++j)
 				{
-					sum = 0;
-
-					for(int k = 1; k < 6; ++k)
-					{
-						sum += cells[i][k] == ids[j - 1][k - 1] ? 0 : 1;
-					}
+					int sum = popcount(row ^ signature(j));
 
 					if(sum < minSum)
 					{
@@ -219,6 +246,107 @@ class ArucoMarker
 			return dist;
 		}
 
+		/**
+		 * Signature rows used to validate the aruco markers, the bit k stores the data cell k + 1 of the row.
+		 * Rows are {1, 0, 0, 0, 0}, {1, 0, 1, 1, 1}, {0, 1, 0, 0, 1}, {0, 1, 1, 1, 0}.
+		 * @param row Two bit value encoded by the row.
+		 * @return Signature row bits.
+		 */
+		static uint64_t signature(int row)
+		{
+			static const uint64_t rows[4] = {0x01, 0x1D, 0x12, 0x0E};
+			return rows[row];
+		}
+
+		/**
+		 * Count the number of bits set.
+		 * @param bits Value to count bits.
+		 * @return Number of bits set.
+		 */
+		static int popcount(uint64_t bits)
+		{
+			#if defined(__GNUC__) || defined(__clang__)
+				return __builtin_popcountll(bits);
+			#else
+				bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+				bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+				bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+				return (int)((bits * 0x0101010101010101ULL) >> 56);
+			#endif
+		}
+
+		/**
+		 * Get the cells of a column packed into 7 bits, bit i stores the row i.
+		 * The column bits are 7 apart, a multiplication moves each one of them to the bit 42 + i without overlaps.
+		 * @param bits Packed cells.
+		 * @param j Column.
+		 * @return Column bits.
+		 */
+		static uint64_t columnBits(uint64_t bits, int j)
+		{
+			return ((((bits >> j) & 0x40810204081ULL) * 0x41041041040ULL) >> 42) & 0x7F;
+		}
+
+		/**
+		 * Border cells folded into 7 bits, the bit i is set if any of the cells (i, 0), (i, 6), (0, i) or (6, i) is white.
+		 * @param bits Packed cells.
+		 * @return Folded border bits.
+		 */
+		static uint64_t borderBits(uint64_t bits)
+		{
+			return columnBits(bits, 0) | columnBits(bits, 6) | (bits & 0x7F) | ((bits >> 42) & 0x7F);
+		}
+
+		/**
+		 * Rotate packed cells 90 degrees, cell (i, j) is moved to (j, 6 - i).
+		 * Uses a precomputed permutation table for each byte of the cells.
+		 * @param bits Packed cells.
+		 * @return Rotated cells.
+		 */
+		static uint64_t rotateBits(uint64_t bits)
+		{
+			static const RotationTable table = RotationTable();
+
+			uint64_t out = 0;
+
+			for(int k = 0; k < 7; k++)
+			{
+				out |= table.bytes[k][(bits >> (8 * k)) & 0xFF];
+			}
+
+			return out;
+		}
+
+		/**
+		 * Permutation table used to rotate the packed cells, stores the rotated bits of each value of each byte.
+		 */
+		struct RotationTable
+		{
+			uint64_t bytes[7][256];
+
+			RotationTable()
+			{
+				for(int k = 0; k < 7; k++)
+				{
+					for(int value = 0; value < 256; value++)
+					{
+						bytes[k][value] = 0;
+
+						for(int b = 0; b < 8; b++)
+						{
+							int bit = k * 8 + b;
+
+							if(bit < 49 && (value >> b) & 1)
+							{
+								int i = bit / 7, j = bit % 7;
+								bytes[k][value] |= (uint64_t) 1 << (j * 7 + (6 - i));
+							}
+						}
+					}
+				}
+			}
+		};
+
 		/**
 		 * Print marker cells to the stdout.
 		 */
@@ -233,7 +361,7 @@ class ArucoMarker
 			{
 				for(int j = 0; j < 7; j++)
 				{
-					cout << cells[i][j] << ", ";
+					cout << getCell(i, j) << ", ";
 				}
 
 				if(i == 6)
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+
+#include "ArucoMarkerInfo.cpp"
+
+using namespace std;
+
+/**
+ * Registry of the known markers indexed by id.
+ * Readers get an immutable snapshot of the registry so lookups on the frame path are lock free and constant time.
+ * Writers copy the current table, modify the copy and publish it, the writers are serialized by a mutex.
+ */
+class ArucoMarkerRegistry
+{
+	public:
+		/**
+		 * Number of marker ids supported by the dictionary.
+		 */
+		static constexpr int IDS = 1024;
+
+		/**
+		 * Immutable table of markers, a dense slot per id stores the index of the marker in the markers list.
+		 */
+		class Table
+		{
+			public:
+				/**
+				 * Registered markers, with their world corners already calculated.
+				 */
+				vector<ArucoMarkerInfo> markers;
+
+				/**
+				 * Index of each id in the markers list, -1 if the id is not registered.
+				 */
+				int16_t index[IDS];
+
+				Table()
+				{
+					for(int i = 0; i < IDS; i++)
+					{
+						index[i] = -1;
+					}
+				}
+
+				/**
+				 * Get a registered marker.
+				 * @param id Marker id.
+				 * @return Marker info or null if the id is not registered.
+				 */
+				const ArucoMarkerInfo *get(int id) const
+				{
+					if(id < 0 || id >= IDS || index[id] < 0)
+					{
+						return nullptr;
+					}
+
+					return &markers[index[id]];
+				}
+
+				/**
+				 * Number of markers registered.
+				 * @return Marker count.
+				 */
+				size_t size() const
+				{
+					return markers.size();
+				}
+		};
+
+		/**
+		 * Current table, read and written atomically.
+		 */
+		shared_ptr<const Table> table;
+
+		/**
+		 * Serializes the writers.
+		 */
+		mutex lock;
+
+		ArucoMarkerRegistry()
+		{
+			table = make_shared<Table>();
+		}
+
+		/**
+		 * Get the current table, the snapshot is not affected by later changes to the registry.
+		 * @return Registry table.
+		 */
+		shared_ptr<const Table> snapshot() const
+		{
+			return atomic_load(&table);
+		}
+
+		/**
+		 * Check if a marker is registered in the current table.
+		 * @param id Marker id.
+		 * @return True if the id is registered.
+		 */
+		bool contains(int id) const
+		{
+			return snapshot()->get(id) != nullptr;
+		}
+
+		/**
+		 * Register a marker, if the id is already registered the marker is replaced.
+		 * @param info Marker to register.
+		 * @return False if the id is outside of the dictionary range.
+		 */
+		bool add(const ArucoMarkerInfo &info)
+		{
+			if(info.id < 0 || info.id >= IDS)
+			{
+				return false;
+			}
+
+			return add(vector<ArucoMarkerInfo>(1, info)) == 1;
+		}
+
+		/**
+		 * Register a list of markers with a single table copy, markers with an id already registered are replaced.
+		 * @param infos Markers to register.
+		 * @return Number of markers registered, markers with an id outside of the dictionary range are skipped.
+		 */
+		unsigned int add(const vector<ArucoMarkerInfo> &infos)
+		{
+			lock_guard<mutex> guard(lock);
+
+			shared_ptr<Table> next = make_shared<Table>(*table);
+			unsigned int count = insert(*next, infos);
+
+			atomic_store(&table, shared_ptr<const Table>(next));
+
+			return count;
+		}
+
+		/**
+		 * Replace all the registered markers in a single swap, readers see either the old or the new markers, never a mix.
+		 * @param infos Markers of the new registry, if an id is repeated the last one is kept.
+		 * @return Number of markers registered, markers with an id outside of the dictionary range are skipped.
+		 */
+		unsigned int replace(const vector<ArucoMarkerInfo> &infos)
+		{
+			shared_ptr<Table> next = make_shared<Table>();
+			next->markers.reserve(infos.size());
+			unsigned int count = insert(*next, infos);
+
+			lock_guard<mutex> guard(lock);
+			atomic_store(&table, shared_ptr<const Table>(next));
+
+			return count;
+		}
+
+		/**
+		 * Insert markers into a table that is not published yet.
+		 * @param target Table to modify.
+		 * @param infos Markers to insert.
+		 * @return Number of markers inserted.
+		 */
+		static unsigned int insert(Table &target, const vector<ArucoMarkerInfo> &infos)
+		{
+			unsigned int count = 0;
+
+			for(unsigned int i = 0; i < infos.size(); i++)
+			{
+				const ArucoMarkerInfo &info = infos[i];
+
+				if(info.id < 0 || info.id >= IDS)
+				{
+					continue;
+				}
+
+				if(target.index[info.id] >= 0)
+				{
+					target.markers[target.index[info.id]] = info;
+				}
+				else
+				{
+					target.index[info.id] = (int16_t) target.markers.size();
+					target.markers.push_back(info);
+				}
+
+				count++;
+			}
+
+			return count;
+		}
+
+		/**
+		 * Remove a marker from the registry.
+		 * The last marker of the list is moved into the removed position.
+		 * @param id Marker id.
+		 * @return True if the marker was registered.
+		 */
+		bool remove(int id)
+		{
+			if(id < 0 || id >= IDS)
+			{
+				return false;
+			}
+
+			lock_guard<mutex> guard(lock);
+
+			if(table->index[id] < 0)
+			{
+				return false;
+			}
+
+			shared_ptr<Table> next = make_shared<Table>(*table);
+
+			int16_t position = next->index[id];
+			next->markers[position] = next->markers.back();
+			next->index[next->markers[position].id] = position;
+			next->markers.pop_back();
+			next->index[id] = -1;
+
+			atomic_store(&table, shared_ptr<const Table>(next));
+
+			return true;
+		}
+
+		/**
+		 * Print all registered markers to the stdout.
+		 */
+		void print() const
+		{
+			shared_ptr<const Table> current = snapshot();
+
+			for(unsigned int i = 0; i < current->markers.size(); i++)
+			{
+				ArucoMarkerInfo info = current->markers[i];
+				info.print();
+			}
+		}
+};
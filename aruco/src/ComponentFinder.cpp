@@ -0,0 +1,157 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "SquareFinder.cpp"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Blob backend, finds quad candidates from the dark connected components of a binary threshold image.
+ * The size, aspect and fill of each blob are read from connectedComponentsWithStats, only the blobs that pass them have their border traced and approximated.
+ * Noise on textured backgrounds forms a few large sparse blobs instead of thousands of small contours.
+ * connectedComponentsWithStats is available since OpenCV 3.0, with OpenCV 2 the outer border of every blob is traced and the checks use the area inside it.
+ */
+class ComponentFinder
+{
+	public:
+		/**
+		 * Minimum fraction of the bounding box covered by a blob, a marker seen rotated 45 degrees with all its data cells white covers about a quarter of it.
+		 */
+		static constexpr double MIN_FILL = 0.2;
+
+		/**
+		 * Inverted binary image, component labels and their stats.
+		 */
+		Mat inverted;
+		Mat labels;
+		Mat statistics;
+		Mat centroids;
+
+		/**
+		 * Mask with the size of the image where each blob is drawn in its bounding box before being traced, its border and polygon approximation.
+		 */
+		Mat mask;
+		vector<vector<Point>> contours;
+		vector<Point> approx;
+
+		/**
+		 * Border hierarchy of the inverted image, only used with OpenCV 2.
+		 */
+		vector<Vec4i> hierarchy;
+
+		/**
+		 * Number of blobs found and rejected by each check in the last image.
+		 */
+		SquareFinder::Stats stats;
+
+		/**
+		 * Detect quads in a binary image.
+		 * The squares vector is used as a pool, slots are overwritten and it only grows when more quads than ever before are found.
+		 * @param binary Binary image, markers are zero pixels.
+		 * @param squares Output pool of quads, only the first (returned count) entries are valid.
+		 * @param limitCosine Limit value for cosine in the quad corners.
+		 * @param minArea Minimum area of the quad.
+		 * @param maxError Max error percentage relative to the square perimeter.
+		 * @param maxAspect Max aspect ratio of the blob bounding box, 0 to disable the check.
+		 * @return Number of quads written into the squares vector.
+		 */
+		unsigned int findSquares(Mat binary, vector<Quadrilateral> &squares, double limitCosine, int minArea, double maxError, double maxAspect)
+		{
+			unsigned int count = 0;
+
+			stats.reset();
+
+			bitwise_not(binary, inverted);
+
+			#if CV_MAJOR_VERSION == 2
+				//Outer borders of the blobs are the top level of the two level hierarchy, holes are the second level
+				findContours(inverted, contours, hierarchy, RETR_CCOMP, CHAIN_APPROX_SIMPLE);
+
+				for(unsigned int i = 0; i < contours.size(); i++)
+				{
+					if(hierarchy[i][3] >= 0)
+					{
+						continue;
+					}
+
+					stats.contours++;
+
+					Rect bounds = boundingRect(contours[i]);
+
+					if(bounds.area() <= minArea)
+					{
+						stats.small++;
+						continue;
+					}
+
+					if(contourArea(contours[i]) < bounds.area() * MIN_FILL)
+					{
+						stats.fill++;
+						continue;
+					}
+
+					if(maxAspect > 0 && MAX(bounds.width, bounds.height) > maxAspect * MIN(bounds.width, bounds.height))
+					{
+						stats.aspect++;
+						continue;
+					}
+
+					if(SquareFinder::isSquare(contours[i], approx, limitCosine, minArea, maxError, maxAspect, stats))
+					{
+						SquareFinder::storeSquare(squares, count, approx);
+						SquareFinder::orientDark(squares[count - 1]);
+					}
+				}
+
+				return count;
+			#else
+				int components = connectedComponentsWithStats(inverted, labels, statistics, centroids, 8, CV_32S);
+
+				//Label 0 is the background
+				stats.contours = components - 1;
+				mask.create(labels.size(), CV_8UC1);
+
+				for(int label = 1; label < components; label++)
+				{
+					const int *blob = statistics.ptr<int>(label);
+					Rect bounds = Rect(blob[CC_STAT_LEFT], blob[CC_STAT_TOP], blob[CC_STAT_WIDTH], blob[CC_STAT_HEIGHT]);
+
+					if(bounds.area() <= minArea)
+					{
+						stats.small++;
+						continue;
+					}
+
+					if(blob[CC_STAT_AREA] < bounds.area() * MIN_FILL)
+					{
+						stats.fill++;
+						continue;
+					}
+
+					if(maxAspect > 0 && MAX(bounds.width, bounds.height) > maxAspect * MIN(bounds.width, bounds.height))
+					{
+						stats.aspect++;
+						continue;
+					}
+
+					//A single 8 connected blob has a single outer border, the view keeps the mask buffer of the whole image
+					Mat region = mask(bounds);
+					compare(labels(bounds), label, region, CMP_EQ);
+					findContours(region, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE, bounds.tl());
+
+					if(SquareFinder::isSquare(contours[0], approx, limitCosine, minArea, maxError, maxAspect, stats))
+					{
+						SquareFinder::storeSquare(squares, count, approx);
+						SquareFinder::orientDark(squares[count - 1]);
+					}
+				}
+
+				return count;
+			#endif
+		}
+};
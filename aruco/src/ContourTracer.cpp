@@ -0,0 +1,242 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "SquareFinder.cpp"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Border follower (Suzuki and Abe) specialized to find quad candidates in a binary threshold image.
+ * Borders are traced in a single raster scan and compressed to their direction changes while they are traced, the same points findContours returns with RETR_LIST and CHAIN_APPROX_SIMPLE.
+ * Only the contour being traced is kept, it is tested as soon as it is traced and discarded if it is not a quad.
+ * The quads found are the same, and in the same order, as SquareFinder::findSquares.
+ */
+class ContourTracer
+{
+	public:
+		/**
+		 * Label of a foreground pixel not traced yet.
+		 */
+		static constexpr uchar FOREGROUND = 1;
+
+		/**
+		 * Label of a traced border pixel.
+		 */
+		static constexpr uchar VISITED = 2;
+
+		/**
+		 * Flag of a traced border pixel with background on its right, a hole border can not start on it.
+		 */
+		static constexpr uchar RIGHT_EDGE = 0x80;
+
+		/**
+		 * Copy of the binary image with a background border, foreground pixels are labeled as they are traced.
+		 */
+		Mat labels;
+
+		/**
+		 * Points of the contour being traced and its polygon approximation.
+		 */
+		vector<Point> contour;
+		vector<Point> approx;
+
+		/**
+		 * Number of contours traced and rejected by each check in the last image.
+		 */
+		SquareFinder::Stats stats;
+
+		/**
+		 * Detect quads in a binary image.
+		 * The squares vector is used as a pool, slots are overwritten and it only grows when more quads than ever before are found.
+		 * @param binary Binary image, any non zero pixel is foreground.
+		 * @param squares Output pool of quads, only the first (returned count) entries are valid.
+		 * @param limitCosine Limit value for cosine in the quad corners.
+		 * @param minArea Minimum area of the quad.
+		 * @param maxError Max error percentage relative to the square perimeter.
+		 * @param maxAspect Max aspect ratio of the contour bounding box, 0 (default) disables the check like the SquareFinder compatibility overload.
+		 * @return Number of quads written into the squares vector.
+		 */
+		unsigned int findSquares(Mat binary, vector<Quadrilateral> &squares, double limitCosine, int minArea, double maxError, double maxAspect = 0.0)
+		{
+			int width = binary.cols;
+			int height = binary.rows;
+			unsigned int count = 0;
+
+			stats.reset();
+
+			//Labels with a one pixel background border so the neighbours never leave the image
+			labels.create(height + 2, width + 2, CV_8UC1);
+			memset(labels.ptr<uchar>(0), 0, width + 2);
+			memset(labels.ptr<uchar>(height + 1), 0, width + 2);
+
+			for(int y = 0; y < height; y++)
+			{
+				const uchar *src = binary.ptr<uchar>(y);
+				uchar *dst = labels.ptr<uchar>(y + 1);
+
+				dst[0] = 0;
+				dst[width + 1] = 0;
+
+				for(int x = 0; x < width; x++)
+				{
+					dst[x + 1] = src[x] != 0;
+				}
+			}
+
+			//Neighbour offsets counter clockwise from the right, repeated so the search can wrap around
+			int step = (int) labels.step;
+			int offsets[16];
+
+			for(int s = 0; s < 16; s++)
+			{
+				offsets[s] = direction(s & 7).y * step + direction(s & 7).x;
+			}
+
+			for(int y = 1; y <= height; y++)
+			{
+				uchar *row = labels.ptr<uchar>(y);
+
+				for(int x = 1; x <= width; x++)
+				{
+					uchar value = row[x];
+
+					if(value == 0)
+					{
+						continue;
+					}
+
+					bool hole;
+
+					//Outer border starts after background, hole border starts before background
+					if(value == FOREGROUND && row[x - 1] == 0)
+					{
+						hole = false;
+					}
+					else if(!(value & RIGHT_EDGE) && row[x + 1] == 0)
+					{
+						hole = true;
+					}
+					else
+					{
+						continue;
+					}
+
+					stats.contours++;
+
+					if(!follow(row + x, Point(x - 1, y - 1), hole, offsets))
+					{
+						stats.points++;
+						continue;
+					}
+
+					if(SquareFinder::isSquare(contour, approx, limitCosine, minArea, maxError, maxAspect, stats))
+					{
+						SquareFinder::storeSquare(squares, count, approx);
+					}
+				}
+			}
+
+			//findContours lists the contours from the last border found to the first
+			std::reverse(squares.begin(), squares.begin() + count);
+
+			return count;
+		}
+
+		/**
+		 * Trace a border and store its direction changes in the contour buffer.
+		 * Border pixels are labeled so the border is not traced again, pixels with background on their right are flagged so no hole border starts on them.
+		 * @param start Label of the first pixel of the border.
+		 * @param origin Position of the first pixel in the binary image.
+		 * @param hole True if the border is the inner border of a hole.
+		 * @param offsets Label offsets of the 8 neighbours counter clockwise from the right, repeated twice.
+		 * @return False if the border is a single pixel.
+		 */
+		bool follow(uchar *start, Point origin, bool hole, const int *offsets)
+		{
+			//Search the first neighbour clockwise from the background pixel
+			int end = hole ? 0 : 4;
+			int s = end;
+			uchar *first;
+
+			do
+			{
+				s = (s - 1) & 7;
+				first = start + offsets[s];
+			}
+			while(*first == 0 && s != end);
+
+			if(s == end)
+			{
+				*start = VISITED | RIGHT_EDGE;
+				return false;
+			}
+
+			contour.clear();
+
+			Point point = origin;
+			uchar *current = start;
+			int previous = s ^ 4;
+
+			while(true)
+			{
+				//Search the next neighbour counter clockwise from the previous pixel
+				end = s;
+				uchar *next;
+
+				do
+				{
+					next = current + offsets[++s];
+				}
+				while(*next == 0);
+
+				s &= 7;
+
+				//The search wrapped over the right neighbour so it is background
+				if((unsigned int) (s - 1) < (unsigned int) end)
+				{
+					*current = VISITED | RIGHT_EDGE;
+				}
+				else if(*current == FOREGROUND)
+				{
+					*current = VISITED;
+				}
+
+				//Only the points where the direction changes are stored
+				if(s != previous)
+				{
+					contour.push_back(point);
+					previous = s;
+				}
+
+				point += direction(s);
+
+				if(next == start && current == first)
+				{
+					break;
+				}
+
+				current = next;
+				s = (s + 4) & 7;
+			}
+
+			return true;
+		}
+
+		/**
+		 * Get a neighbour direction, directions are counter clockwise from the right (y points down).
+		 * @param s Direction code from 0 to 7.
+		 * @return Offset of the neighbour.
+		 */
+		static Point direction(int s)
+		{
+			static const Point directions[8] = {Point(1, 0), Point(1, -1), Point(0, -1), Point(-1, -1), Point(-1, 0), Point(-1, 1), Point(0, 1), Point(1, 1)};
+			return directions[s];
+		}
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "SquareFinder.cpp"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Edge backend, finds quad candidates from the Canny edges of the grayscale image instead of a threshold.
+ * Edges are dilated so the broken edges of a blurred marker close into a ring, the outer border of each ring that approximates to a quad gets its corners from the intersection of lines fitted to the undilated edge pixels along its sides.
+ * Edges follow the gradient so they still find markers when motion blur smears the threshold borders.
+ */
+class EdgeFinder
+{
+	public:
+		/**
+		 * Distance in pixels from the sides of the approximated quad where the edge pixels of each side are searched, covers the dilation and the offset of the outer border.
+		 */
+		static constexpr int BAND = 3;
+
+		/**
+		 * Canny hysteresis thresholds.
+		 */
+		double lowThreshold;
+		double highThreshold;
+
+		/**
+		 * Edge image and its dilated version, the contours of the dilated edges, the polygon approximation and the edge pixels of the side being fitted.
+		 */
+		Mat edges;
+		Mat dilated;
+		vector<vector<Point>> contours;
+		vector<Vec4i> hierarchy;
+		vector<Point> approx;
+		vector<Point> side;
+
+		/**
+		 * Number of contours found and rejected by each check in the last image.
+		 */
+		SquareFinder::Stats stats;
+
+		EdgeFinder(double _lowThreshold = 50.0, double _highThreshold = 150.0)
+		{
+			lowThreshold = _lowThreshold;
+			highThreshold = _highThreshold;
+		}
+
+		/**
+		 * Detect quads in a grayscale image.
+		 * The squares vector is used as a pool, slots are overwritten and it only grows when more quads than ever before are found.
+		 * @param gray Grayscale image.
+		 * @param squares Output pool of quads, only the first (returned count) entries are valid.
+		 * @param limitCosine Limit value for cosine in the quad corners.
+		 * @param minArea Minimum area of the quad.
+		 * @param maxError Max error percentage relative to the square perimeter.
+		 * @param maxAspect Max aspect ratio of the contour bounding box, 0 to disable the check.
+		 * @return Number of quads written into the squares vector.
+		 */
+		unsigned int findSquares(Mat gray, vector<Quadrilateral> &squares, double limitCosine, int minArea, double maxError, double maxAspect)
+		{
+			unsigned int count = 0;
+
+			stats.reset();
+
+			Canny(gray, edges, lowThreshold, highThreshold);
+			dilate(edges, dilated, Mat());
+
+			//Only the outer border of each ring is used, its hole border is the same quad shrunk by the dilation
+			findContours(dilated, contours, hierarchy, RETR_CCOMP, CHAIN_APPROX_SIMPLE);
+
+			for(unsigned int i = 0; i < contours.size(); i++)
+			{
+				if(hierarchy[i][3] >= 0)
+				{
+					continue;
+				}
+
+				stats.contours++;
+
+				if(!SquareFinder::isSquare(contours[i], approx, limitCosine, minArea, maxError, maxAspect, stats))
+				{
+					continue;
+				}
+
+				SquareFinder::storeSquare(squares, count, approx);
+
+				Quadrilateral &quad = squares[count - 1];
+				fitCorners(quad);
+				SquareFinder::orientDark(quad);
+			}
+
+			return count;
+		}
+
+		/**
+		 * Replace the corners of a quad by the intersections of lines fitted to the edge pixels along each side.
+		 * The corners are kept if a side has too few edge pixels or two sides are parallel.
+		 * @param quad Quad approximated from the outer border of a dilated edge ring.
+		 */
+		void fitCorners(Quadrilateral &quad)
+		{
+			Vec4f lines[4];
+
+			for(int j = 0; j < 4; j++)
+			{
+				sideEdges(quad.points[j], quad.points[(j + 1) % 4]);
+
+				if(side.size() < 2)
+				{
+					return;
+				}
+
+				#if CV_MAJOR_VERSION == 2
+					fitLine(side, lines[j], CV_DIST_L2, 0, 0.01, 0.01);
+				#else
+					fitLine(side, lines[j], DIST_L2, 0, 0.01, 0.01);
+				#endif
+			}
+
+			//Corner j is shared by the sides j - 1 and j
+			Point2f corners[4];
+
+			for(int j = 0; j < 4; j++)
+			{
+				const Vec4f &a = lines[(j + 3) % 4];
+				const Vec4f &b = lines[j];
+				float den = a[0] * b[1] - a[1] * b[0];
+
+				if(fabs(den) < 1e-6f)
+				{
+					return;
+				}
+
+				float t = ((b[2] - a[2]) * b[1] - (b[3] - a[3]) * b[0]) / den;
+				corners[j] = Point2f(a[2] + t * a[0], a[3] + t * a[1]);
+			}
+
+			for(int j = 0; j < 4; j++)
+			{
+				quad.points[j] = corners[j];
+			}
+		}
+
+		/**
+		 * Collect into the side buffer the edge pixels near the segment between two corners.
+		 * The segment is walked along its major axis without the eighth closest to each corner, where the blur rounds the edges, and the pixels across it are searched up to half a marker cell so the edges of the bits are not taken.
+		 * @param a First corner.
+		 * @param b Second corner.
+		 */
+		void sideEdges(Point2f a, Point2f b)
+		{
+			side.clear();
+
+			Point2f direction = b - a;
+			double length = norm(direction);
+
+			if(length < 1.0)
+			{
+				return;
+			}
+
+			bool horizontal = fabs(direction.x) >= fabs(direction.y);
+			int band = std::min(BAND, std::max(1, (int) (length / 14.0)));
+
+			float start = horizontal ? std::min(a.x, b.x) : std::min(a.y, b.y);
+			float end = horizontal ? std::max(a.x, b.x) : std::max(a.y, b.y);
+			float trim = (end - start) / 8.0f;
+
+			for(int t = (int) ceil(start + trim); t <= (int) floor(end - trim); t++)
+			{
+				float across = horizontal ? a.y + (t - a.x) * direction.y / direction.x : a.x + (t - a.y) * direction.x / direction.y;
+				int center = cvRound(across);
+
+				for(int k = center - band; k <= center + band; k++)
+				{
+					int x = horizontal ? t : k;
+					int y = horizontal ? k : t;
+
+					if(x >= 0 && y >= 0 && x < edges.cols && y < edges.rows && edges.at<uchar>(y, x) != 0)
+					{
+						side.push_back(Point(x, y));
+					}
+				}
+			}
+		}
+};
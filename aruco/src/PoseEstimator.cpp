@@ -0,0 +1,231 @@
+#pragma once
+
+#include <vector>
+#include <math.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+using namespace cv;
+using namespace std;
+
+//Closed form square solver (SOLVEPNP_IPPE_SQUARE) and LM refinement are available since OpenCV 4.1
+#if CV_MAJOR_VERSION > 4 || (CV_MAJOR_VERSION == 4 && CV_MINOR_VERSION >= 1)
+	#define POSE_IPPE_SQUARE true
+#else
+	#define POSE_IPPE_SQUARE false
+#endif
+
+/**
+ * Estimates the camera pose from the corners of the known markers visible.
+ * When a single marker is visible the pose is solved in closed form with the square solver.
+ * Otherwise Levenberg-Marquardt is seeded with the pose of the previous frame, if the seeded solution does not fit the points it is solved again from scratch.
+ * Keeps the pose between frames, one instance should be used per camera.
+ */
+class PoseEstimator
+{
+	public:
+		/**
+		 * If true the iterative solver starts from the previous pose.
+		 */
+		bool warmStart;
+
+		/**
+		 * If true a single marker is solved with the square solver.
+		 */
+		bool squareSolver;
+
+		/**
+		 * Maximum RMS reprojection error in pixels of a warm started solution, above it the pose is solved again without the guess.
+		 */
+		double maxError;
+
+		/**
+		 * Rotation (Rodrigues) and translation of the world relative to the camera solved in the last frame.
+		 */
+		Mat rotation, position;
+
+		/**
+		 * True if rotation and position hold the pose of the previous frame.
+		 */
+		bool valid;
+
+		/**
+		 * RMS reprojection error in pixels of the last pose.
+		 */
+		double error;
+
+		/**
+		 * True if the last pose was solved with the square solver, or seeded with the previous pose.
+		 */
+		bool square, guessed;
+
+		PoseEstimator(bool _warmStart = true, bool _squareSolver = true, double _maxError = 2.0)
+		{
+			warmStart = _warmStart;
+			squareSolver = _squareSolver;
+			maxError = _maxError;
+			valid = false;
+			error = 0.0;
+			square = false;
+			guessed = false;
+		}
+
+		/**
+		 * Forget the previous pose, should be called when no marker is visible.
+		 */
+		void reset()
+		{
+			valid = false;
+		}
+
+		/**
+		 * Solve the pose from the world points and their projections.
+		 * @param world World points, 4 per marker in the ArucoMarkerInfo order.
+		 * @param projected Projected points in the image.
+		 * @param camera Camera calibration matrix.
+		 * @param distortion Lenses distortion.
+		 * @return True if the pose was solved.
+		 */
+		bool solve(const vector<Point3f> &world, const vector<Point2f> &projected, Mat camera, Mat distortion)
+		{
+			if(world.size() < 4 || world.size() != projected.size())
+			{
+				valid = false;
+				return false;
+			}
+
+			square = squareSolver && world.size() == 4 && solveSquare(world, projected, camera, distortion, rotation, position);
+			guessed = false;
+
+			if(!square)
+			{
+				guessed = warmStart && valid;
+
+				#if CV_MAJOR_VERSION == 2
+					solvePnP(world, projected, camera, distortion, rotation, position, guessed, ITERATIVE);
+				#else
+					solvePnP(world, projected, camera, distortion, rotation, position, guessed, SOLVEPNP_ITERATIVE);
+				#endif
+
+				//The previous pose was too far away, the solver converged to a wrong minimum
+				if(guessed && reprojectionError(world, projected, camera, distortion, rotation, position) > maxError)
+				{
+					guessed = false;
+
+					#if CV_MAJOR_VERSION == 2
+						solvePnP(world, projected, camera, distortion, rotation, position, false, ITERATIVE);
+					#else
+						solvePnP(world, projected, camera, distortion, rotation, position, false, SOLVEPNP_ITERATIVE);
+					#endif
+				}
+			}
+
+			error = reprojectionError(world, projected, camera, distortion, rotation, position);
+			valid = true;
+
+			return true;
+		}
+
+		/**
+		 * Solve the pose of a single marker with the closed form square solver (IPPE square).
+		 * The solver needs the marker corners in its own coordinates, so the marker frame is built from the world corners and the solution is moved to world coordinates.
+		 * @param world World corners of the marker in the ArucoMarkerInfo order (TopLeft, TopRight, BottomRight, BottomLeft).
+		 * @param projected Projected corners.
+		 * @param camera Camera calibration matrix.
+		 * @param distortion Lenses distortion.
+		 * @param rotation Output rotation (Rodrigues) of the world relative to the camera.
+		 * @param position Output translation of the world relative to the camera.
+		 * @return False if the square solver is not available.
+		 */
+		static bool solveSquare(const vector<Point3f> &world, const vector<Point2f> &projected, Mat camera, Mat distortion, Mat &rotation, Mat &position)
+		{
+			#if POSE_IPPE_SQUARE
+				//Marker frame, origin in the center and axes along the sides
+				Vec3d p0 = Vec3d(world[0].x, world[0].y, world[0].z);
+				Vec3d p1 = Vec3d(world[1].x, world[1].y, world[1].z);
+				Vec3d p2 = Vec3d(world[2].x, world[2].y, world[2].z);
+				Vec3d p3 = Vec3d(world[3].x, world[3].y, world[3].z);
+
+				Vec3d center = (p0 + p1 + p2 + p3) * 0.25;
+				Vec3d x = p3 - p0;
+				Vec3d y = p1 - p0;
+				double side = (norm(x) + norm(y)) / 2.0;
+
+				x = x / norm(x);
+				y = y / norm(y);
+				Vec3d z = x.cross(y);
+
+				Matx33d frame = Matx33d(x[0], y[0], z[0], x[1], y[1], z[1], x[2], y[2], z[2]);
+
+				//Square solver expects (-s/2, s/2), (s/2, s/2), (s/2, -s/2), (-s/2, -s/2)
+				float half = (float) side / 2.0f;
+
+				vector<Point3f> local;
+				local.push_back(Point3f(-half, half, 0));
+				local.push_back(Point3f(half, half, 0));
+				local.push_back(Point3f(half, -half, 0));
+				local.push_back(Point3f(-half, -half, 0));
+
+				vector<Point2f> image;
+				image.push_back(projected[1]);
+				image.push_back(projected[2]);
+				image.push_back(projected[3]);
+				image.push_back(projected[0]);
+
+				Mat localRotation, localPosition;
+
+				if(!solvePnP(local, image, camera, distortion, localRotation, localPosition, false, SOLVEPNP_IPPE_SQUARE))
+				{
+					return false;
+				}
+
+				//Camera from world = camera from marker * marker from world
+				Matx33d markerRotation;
+				Rodrigues(localRotation, markerRotation);
+
+				Matx33d worldRotation = markerRotation * frame.t();
+				Vec3d worldPosition = Vec3d(localPosition.at<double>(0, 0), localPosition.at<double>(1, 0), localPosition.at<double>(2, 0)) - worldRotation * center;
+
+				Rodrigues(Mat(worldRotation), rotation);
+				position = Mat(worldPosition).clone();
+
+				return true;
+			#else
+				(void) world;
+				(void) projected;
+				(void) camera;
+				(void) distortion;
+				(void) rotation;
+				(void) position;
+
+				return false;
+			#endif
+		}
+
+		/**
+		 * Calculate the RMS reprojection error of a pose.
+		 * @param world World points.
+		 * @param projected Projected points in the image.
+		 * @param camera Camera calibration matrix.
+		 * @param distortion Lenses distortion.
+		 * @param rotation Rotation (Rodrigues).
+		 * @param position Translation.
+		 * @return RMS error in pixels.
+		 */
+		static double reprojectionError(const vector<Point3f> &world, const vector<Point2f> &projected, Mat camera, Mat distortion, Mat rotation, Mat position)
+		{
+			vector<Point2f> points;
+			projectPoints(world, rotation, position, camera, distortion, points);
+
+			double sum = 0.0;
+
+			for(unsigned int i = 0; i < points.size(); i++)
+			{
+				Point2f diff = points[i] - projected[i];
+				sum += diff.dot(diff);
+			}
+
+			return sqrt(sum / points.size());
+		}
+};
@@ -1,16 +1,149 @@
 #pragma once
 
+#include <string>
+
 #include "math/Quadrilateral.cpp"
 
 using namespace cv;
 using namespace std;
 
+/**
+ * Source of the quad candidates, every backend outputs the same quads pool and fills the same rejection counters.
+ */
+enum QuadBackend
+{
+	BACKEND_CONTOURS = 0,
+	BACKEND_TRACER = 1,
+	BACKEND_COMPONENTS = 2,
+	BACKEND_EDGES = 3,
+	BACKEND_COUNT = 4
+};
+
 /**
  * SquareFinder can be used to detect distorted squares in images.
  */
 class SquareFinder
 {
 	public:
+		/**
+		 * Number of contours found and rejected by each check, the checks run in the order of the fields.
+		 */
+		class Stats
+		{
+			public:
+				/**
+				 * Contours found in the image.
+				 */
+				unsigned int contours;
+
+				/**
+				 * Contours not tested because they are inside the data area of a square already accepted (hierarchy pruning).
+				 */
+				unsigned int pruned;
+
+				/**
+				 * Contours with less than 4 points, they can not approximate a quad.
+				 */
+				unsigned int points;
+
+				/**
+				 * Contours with a bounding box too small to hold a square of the minimum area.
+				 */
+				unsigned int small;
+
+				/**
+				 * Blobs covering too little of their bounding box to be a marker, only counted by the components backend.
+				 */
+				unsigned int fill;
+
+				/**
+				 * Contours with a bounding box too elongated to hold a marker.
+				 */
+				unsigned int aspect;
+
+				/**
+				 * Contours shorter than the perimeter of a square of the minimum area.
+				 */
+				unsigned int perimeter;
+
+				/**
+				 * Approximations rejected because they do not have 4 vertices, their area is below the minimum, they are not convex or their corners are not close to 90 degrees.
+				 */
+				unsigned int vertices;
+				unsigned int area;
+				unsigned int convex;
+				unsigned int angle;
+
+				/**
+				 * Squares accepted.
+				 */
+				unsigned int squares;
+
+				Stats()
+				{
+					reset();
+				}
+
+				/**
+				 * Set all the counters to zero.
+				 */
+				void reset()
+				{
+					contours = 0;
+					pruned = 0;
+					points = 0;
+					small = 0;
+					fill = 0;
+					aspect = 0;
+					perimeter = 0;
+					vertices = 0;
+					area = 0;
+					convex = 0;
+					angle = 0;
+					squares = 0;
+				}
+
+				/**
+				 * Add the counters of another search, used to sum the stats of the tiles of a frame.
+				 * @param other Stats to add.
+				 */
+				void add(const Stats &other)
+				{
+					contours += other.contours;
+					pruned += other.pruned;
+					points += other.points;
+					small += other.small;
+					fill += other.fill;
+					aspect += other.aspect;
+					perimeter += other.perimeter;
+					vertices += other.vertices;
+					area += other.area;
+					convex += other.convex;
+					angle += other.angle;
+					squares += other.squares;
+				}
+
+				/**
+				 * Number of contours rejected by the cheap filters, before the polygon approximation.
+				 * @return Contours filtered.
+				 */
+				unsigned int filtered() const
+				{
+					return points + small + fill + aspect + perimeter;
+				}
+		};
+
+		/**
+		 * Children of an accepted dark square with a bounding box smaller than this fraction of the square bounding box are pruned.
+		 * The data area of a marker is 25/49 of the marker, larger children (e.g. a sheet of paper inside a dark frame) are still searched.
+		 */
+		static constexpr double PRUNE_FRACTION = 0.6;
+
+		/**
+		 * Default limit of the bounding box aspect ratio of the contours, a marker seen this tilted has cells too thin to be decoded.
+		 */
+		static constexpr double MAX_ASPECT = 8.0;
+
 		/**
 		 * Detect quads in grayscale image.
 		 * @param gray Grayscale image.
@@ -25,45 +158,290 @@ class SquareFinder
 
 			//Contours
 			vector<vector<Point>> contours;
+			vector<Point> approx;
+
+			unsigned int count = findSquares(gray, squares, contours, approx, limitCosine, minArea, maxError);
+			squares.resize(count);
+
+			return squares;
+		}
+
+		/**
+		 * Detect quads in grayscale image reusing the buffers provided by the caller, without pruning and without the aspect check so the quads are the same as before the filters were added.
+		 * @param gray Grayscale image.
+		 * @param squares Output pool of quads, only the first (returned count) entries are valid.
+		 * @param contours Contour buffer reused between calls.
+		 * @param approx Polygon approximation buffer reused between calls.
+		 * @param limitCosine Limit value for cosine in the quad corners.
+		 * @param minArea Minimum area of the quad.
+		 * @param maxError Max error percentage relative to the square perimeter.
+		 * @return Number of quads written into the squares vector.
+		 */
+		static unsigned int findSquares(Mat gray, vector<Quadrilateral> &squares, vector<vector<Point>> &contours, vector<Point> &approx, double limitCosine, int minArea, double maxError)
+		{
+			vector<Vec4i> hierarchy;
+			vector<Point> stack;
+			Stats stats;
+
+			return findSquares(gray, squares, contours, hierarchy, stack, approx, limitCosine, minArea, maxError, 0.0, false, stats);
+		}
+
+		/**
+		 * Detect quads in grayscale image reusing the buffers provided by the caller.
+		 * The squares vector is used as a pool, slots are overwritten and it only grows when more quads than ever before are found.
+		 * With pruning the contour tree is searched from the outside in and the small children of each dark square accepted (the bit cells of a marker) are not tested.
+		 * @param gray Grayscale image.
+		 * @param squares Output pool of quads, only the first (returned count) entries are valid.
+		 * @param contours Contour buffer reused between calls.
+		 * @param hierarchy Contour tree buffer reused between calls, only used with pruning.
+		 * @param stack Contour tree search buffer reused between calls, only used with pruning.
+		 * @param approx Polygon approximation buffer reused between calls.
+		 * @param limitCosine Limit value for cosine in the quad corners.
+		 * @param minArea Minimum area of the quad.
+		 * @param maxError Max error percentage relative to the square perimeter.
+		 * @param maxAspect Max aspect ratio of the contour bounding box, 0 to disable the check.
+		 * @param prune If true the children of the squares accepted are pruned.
+		 * @param stats Output number of contours rejected by each check.
+		 * @return Number of quads written into the squares vector.
+		 */
+		static unsigned int findSquares(Mat gray, vector<Quadrilateral> &squares, vector<vector<Point>> &contours, vector<Vec4i> &hierarchy, vector<Point> &stack, vector<Point> &approx, double limitCosine, int minArea, double maxError, double maxAspect, bool prune, Stats &stats)
+		{
+			unsigned int count = 0;
+			stats.reset();
 
 			//Find contours and store them all as a list
-			findContours(gray, contours, RETR_LIST, CHAIN_APPROX_SIMPLE);
-			vector<Point> approx;
+			if(!prune)
+			{
+				findContours(gray, contours, RETR_LIST, CHAIN_APPROX_SIMPLE);
+				stats.contours = contours.size();
 
-			for(unsigned int i = 0; i < contours.size(); i++)
+				for(unsigned int i = 0; i < contours.size(); i++)
+				{
+					if(isSquare(contours[i], approx, limitCosine, minArea, maxError, maxAspect, stats))
+					{
+						storeSquare(squares, count, approx);
+					}
+				}
+
+				return count;
+			}
+
+			//Find contours as a tree, the contours at odd depths are the borders of dark regions
+			findContours(gray, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE);
+			stats.contours = contours.size();
+
+			//Depth first from the outer contours, the stack stores the contour and its depth
+			stack.clear();
+
+			for(unsigned int root = 0; root < contours.size(); root++)
 			{
-				//Approximate contour with accuracy proportional to the contour perimeter
-				approxPolyDP(Mat(contours[i]), approx, arcLength(Mat(contours[i]), true) * maxError, true);
+				if(hierarchy[root][3] >= 0)
+				{
+					continue;
+				}
+
+				stack.push_back(Point(root, 0));
 
-				//Square contours have 4 vertices after approximation relatively large area (to filter out noisy contours)and be convex.
-				if(approx.size() == 4 && fabs(contourArea(Mat(approx))) > minArea && isContourConvex(Mat(approx)))
+				while(!stack.empty())
 				{
-					float maxCosine = 0;
+					int i = stack.back().x;
+					int depth = stack.back().y;
+					stack.pop_back();
 
-					//Find the maximum cosine of the angle between joint edges
-					for(int j = 2; j < 5; j++)
+					bool accepted = isSquare(contours[i], approx, limitCosine, minArea, maxError, maxAspect, stats);
+
+					if(accepted)
 					{
-						float cosine = fabs(angleCornerPointsCos(approx[j%4], approx[j-2], approx[j-1]));
-						maxCosine = MAX(maxCosine, cosine);
+						storeSquare(squares, count, approx);
 					}
 
-					//Check if all angle corner close to 90 (more than the max cosine)
-					if(maxCosine < limitCosine)
+					double limit = accepted && depth % 2 == 1 ? boundingRect(contours[i]).area() * PRUNE_FRACTION : 0.0;
+
+					for(int child = hierarchy[i][2]; child >= 0; child = hierarchy[child][0])
 					{
-						Quadrilateral quad = Quadrilateral();
-						
-						for(int j = 0; !approx.empty() && j < 4; j++)
+						if(boundingRect(contours[child]).area() < limit)
 						{
-							quad.points[j] = approx.back();
-							approx.pop_back();
+							stats.pruned += subtreeSize(hierarchy, child);
+						}
+						else
+						{
+							stack.push_back(Point(child, depth + 1));
 						}
-
-						squares.push_back(quad);
 					}
 				}
 			}
 
-			return squares;
+			return count;
+		}
+
+		/**
+		 * Count the contours of a subtree of the contour tree.
+		 * @param hierarchy Contour tree.
+		 * @param root Root of the subtree.
+		 * @return Number of contours in the subtree, including the root.
+		 */
+		static unsigned int subtreeSize(const vector<Vec4i> &hierarchy, int root)
+		{
+			unsigned int size = 1;
+
+			for(int child = hierarchy[root][2]; child >= 0; child = hierarchy[child][0])
+			{
+				size += subtreeSize(hierarchy, child);
+			}
+
+			return size;
+		}
+
+		/**
+		 * Check if a contour is a marker candidate, the contour is approximated with accuracy proportional to its perimeter.
+		 * Square contours have 4 vertices after approximation, relatively large area (to filter out noisy contours), are convex and have corners close to 90 degrees.
+		 * Most contours are threshold noise, they are rejected by cheap checks on their size and bounding box before the approximation.
+		 * @param contour Contour points.
+		 * @param approx Output polygon approximation of the contour.
+		 * @param limitCosine Limit value for cosine in the quad corners.
+		 * @param minArea Minimum area of the quad.
+		 * @param maxError Max error percentage relative to the square perimeter.
+		 * @param maxAspect Max aspect ratio of the contour bounding box, 0 to disable the check.
+		 * @param stats Rejection counters, the check that rejected the contour is incremented.
+		 * @return True if the approximation is a square candidate.
+		 */
+		static bool isSquare(const vector<Point> &contour, vector<Point> &approx, double limitCosine, int minArea, double maxError, double maxAspect, Stats &stats)
+		{
+			//Simple chains store only the direction changes, a quad has at least 4
+			if(contour.size() < 4)
+			{
+				stats.points++;
+				return false;
+			}
+
+			//The square is inside the bounding box of the contour
+			Rect bounds = boundingRect(contour);
+
+			if(bounds.area() <= minArea)
+			{
+				stats.small++;
+				return false;
+			}
+
+			if(maxAspect > 0 && MAX(bounds.width, bounds.height) > maxAspect * MIN(bounds.width, bounds.height))
+			{
+				stats.aspect++;
+				return false;
+			}
+
+			//The approximation vertices are contour points so its perimeter is at most the contour length, a square has the shortest perimeter for its area
+			double length = arcLength(Mat(contour), true);
+
+			if(length < 4.0 * sqrt((double) minArea))
+			{
+				stats.perimeter++;
+				return false;
+			}
+
+			approxPolyDP(Mat(contour), approx, length * maxError, true);
+
+			if(approx.size() != 4)
+			{
+				stats.vertices++;
+				return false;
+			}
+
+			if(fabs(contourArea(Mat(approx))) <= minArea)
+			{
+				stats.area++;
+				return false;
+			}
+
+			if(!isContourConvex(Mat(approx)))
+			{
+				stats.convex++;
+				return false;
+			}
+
+			float maxCosine = 0;
+
+			//Find the maximum cosine of the angle between joint edges
+			for(int j = 2; j < 5; j++)
+			{
+				float cosine = fabs(angleCornerPointsCos(approx[j%4], approx[j-2], approx[j-1]));
+				maxCosine = MAX(maxCosine, cosine);
+			}
+
+			//Check if all angle corner close to 90 (more than the max cosine)
+			if(maxCosine >= limitCosine)
+			{
+				stats.angle++;
+				return false;
+			}
+
+			stats.squares++;
+
+			return true;
+		}
+
+		/**
+		 * Store a square in the quad pool, the pool only grows when it is full.
+		 * @param squares Pool of quads.
+		 * @param count Number of valid quads in the pool, incremented.
+		 * @param approx Square approximation, points are stored in reverse order.
+		 */
+		static void storeSquare(vector<Quadrilateral> &squares, unsigned int &count, const vector<Point> &approx)
+		{
+			if(count == squares.size())
+			{
+				squares.push_back(Quadrilateral());
+			}
+
+			Quadrilateral &quad = squares[count++];
+
+			for(int j = 0; j < 4; j++)
+			{
+				quad.points[j] = approx[3 - j];
+			}
+		}
+
+		/**
+		 * Set the corner order of a quad to the order of a hole border (dark inside) of findContours.
+		 * Markers are only decoded with this corner order, backends that do not know which side of the border is dark use it for every quad.
+		 * @param quad Quad to reorder.
+		 */
+		static void orientDark(Quadrilateral &quad)
+		{
+			if(contourArea(quad.points, true) > 0)
+			{
+				std::swap(quad.points[1], quad.points[3]);
+			}
+		}
+
+		/**
+		 * Get the name of a quad backend.
+		 * @param backend Backend.
+		 * @return Backend name, the same used by the node parameters.
+		 */
+		static const char *backendName(QuadBackend backend)
+		{
+			static const char *names[BACKEND_COUNT] = {"contours", "tracer", "components", "edges"};
+			return names[backend];
+		}
+
+		/**
+		 * Get a quad backend from its name.
+		 * @param name Backend name.
+		 * @param backend Output backend, not modified if the name is unknown.
+		 * @return False if the name is unknown.
+		 */
+		static bool backendFromName(const string &name, QuadBackend &backend)
+		{
+			for(int i = 0; i < BACKEND_COUNT; i++)
+			{
+				if(name == backendName((QuadBackend) i))
+				{
+					backend = (QuadBackend) i;
+					return true;
+				}
+			}
+
+			return false;
 		}
 
 		/**
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <chrono>
+
+//Stage timing switch, when set to 0 the timing code is removed from the detector and the node
+#ifndef ARUCO_PROFILE
+	#define ARUCO_PROFILE 1
+#endif
+
+using namespace std;
+
+/**
+ * Monotonic clock used to measure the time spent in each processing stage.
+ */
+class StageTimer
+{
+	public:
+		/**
+		 * Get current time in milliseconds.
+		 * @return Time in milliseconds.
+		 */
+		static double now()
+		{
+			return chrono::duration<double, milli>(chrono::steady_clock::now().time_since_epoch()).count();
+		}
+};
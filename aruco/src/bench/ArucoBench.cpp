@@ -0,0 +1,1457 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+//Image decoding is in highgui in OpenCV 2 and in its own module since OpenCV 3
+#if CV_MAJOR_VERSION == 2
+	#include <opencv2/highgui/highgui.hpp>
+#else
+	#include <opencv2/imgcodecs/imgcodecs.hpp>
+#endif
+
+#include "../ArucoDetector.cpp"
+#include "../PoseEstimator.cpp"
+#include "../ArucoMarkerRegistry.cpp"
+
+//Directory with the repository images, defined by CMake
+#ifndef ARUCO_IMAGES
+	#define ARUCO_IMAGES "images"
+#endif
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Get current time in milliseconds from a monotonic clock.
+ * @return Time in milliseconds.
+ */
+double now()
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Render a marker into a grayscale image with a white quiet zone of one cell around it.
+ * @param id ID of the marker.
+ * @param size Size of the output image in pixels.
+ * @return Marker image.
+ */
+Mat renderMarker(int id, int size)
+{
+	ArucoMarker marker = ArucoMarker();
+	marker.encodeID(id);
+
+	Mat grid = Mat(9, 9, CV_8UC1, Scalar(255));
+
+	for(int i = 0; i < 7; i++)
+	{
+		for(int j = 0; j < 7; j++)
+		{
+			grid.at<uchar>(i + 1, j + 1) = marker.getCell(i, j) * 255;
+		}
+	}
+
+	Mat out;
+	resize(grid, out, Size(size, size), 0, 0, INTER_NEAREST);
+
+	return out;
+}
+
+/**
+ * Create a synthetic BGR frame with markers placed over a blurred noise background.
+ * Markers are placed in a grid with random scale and perspective distortion.
+ * Clutter adds dark squares with random content that produce quad candidates that are not markers.
+ * @param size Size of the frame.
+ * @param count Number of markers to place.
+ * @param rng Random number generator.
+ * @param ids Output with the ids of the markers placed in the frame.
+ * @param clutter Number of distractor squares.
+ * @return Synthetic frame.
+ */
+Mat syntheticFrame(Size size, int count, RNG &rng, vector<int> &ids, int clutter = 0)
+{
+	Mat gray = Mat(size, CV_8UC1);
+	rng.fill(gray, RNG::UNIFORM, 30, 225);
+	GaussianBlur(gray, gray, Size(0, 0), 2.0);
+
+	//Distractor squares
+	for(int k = 0; k < clutter; k++)
+	{
+		int side = rng.uniform(12, 60);
+		Point corner = Point(rng.uniform(0, std::max(size.width - side, 1)), rng.uniform(0, std::max(size.height - side, 1)));
+
+		rectangle(gray, Rect(corner.x, corner.y, side, side), Scalar(rng.uniform(0, 40)), -1);
+		rectangle(gray, Rect(corner.x + side / 4, corner.y + side / 4, side / 2, side / 2), Scalar(rng.uniform(150, 255)), -1);
+	}
+
+	ids.clear();
+
+	//Grid of slots where the markers are placed
+	int slot = std::min(std::max(std::min(size.width, size.height) / 5, 40), 240);
+	int cols = std::max(size.width / slot, 1);
+	int rows = std::max(size.height / slot, 1);
+	count = std::min(count, cols * rows);
+
+	for(int k = 0; k < count; k++)
+	{
+		int id = rng.uniform(0, 1024);
+		int side = (int)(slot * rng.uniform(0.45, 0.8));
+		Mat marker = renderMarker(id, side);
+
+		Point2f center = Point2f((k % cols + 0.5f) * slot, (k / cols + 0.5f) * slot);
+
+		vector<Point2f> src, dst;
+		src.push_back(Point2f(0, 0));
+		src.push_back(Point2f(side, 0));
+		src.push_back(Point2f(side, side));
+		src.push_back(Point2f(0, side));
+
+		for(int j = 0; j < 4; j++)
+		{
+			Point2f offset = src[j] - Point2f(side / 2.0f, side / 2.0f);
+			Point2f jitter = Point2f(rng.uniform(-0.12f, 0.12f), rng.uniform(-0.12f, 0.12f)) * side;
+			dst.push_back(center + offset + jitter);
+		}
+
+		Mat transformation = getPerspectiveTransform(src, dst);
+		warpPerspective(marker, gray, transformation, size, INTER_LINEAR, BORDER_TRANSPARENT);
+
+		ids.push_back(id);
+	}
+
+	Mat frame;
+	cvtColor(gray, frame, COLOR_GRAY2BGR);
+
+	return frame;
+}
+
+/**
+ * Get a percentile of a list of samples.
+ * @param samples Samples, reordered by the call.
+ * @param rank Percentile between 0 and 100.
+ * @return Value of the percentile.
+ */
+double percentile(vector<double> &samples, double rank)
+{
+	if(samples.empty())
+	{
+		return 0.0;
+	}
+
+	size_t index = std::min((size_t)(rank / 100.0 * samples.size()), samples.size() - 1);
+	nth_element(samples.begin(), samples.begin() + index, samples.end());
+
+	return samples[index];
+}
+
+/**
+ * Print the latency percentiles and throughput of a stage.
+ * @param name Name of the stage.
+ * @param samples Time of each run of the stage in milliseconds.
+ */
+void printStage(const string &name, vector<double> &samples)
+{
+	double total = 0.0;
+
+	for(unsigned int i = 0; i < samples.size(); i++)
+	{
+		total += samples[i];
+	}
+
+	double mean = samples.empty() ? 0.0 : total / samples.size();
+
+	cout << "  " << left << setw(12) << name << right << " p50 " << setw(8) << percentile(samples, 50) << " ms  p95 " << setw(8) << percentile(samples, 95) << " ms  p99 " << setw(8) << percentile(samples, 99) << " ms  " << setw(10) << (mean > 0.0 ? 1000.0 / mean : 0.0) << " frames/s" << endl;
+}
+
+/**
+ * Measure each stage of the detection pipeline: gray conversion, adaptive threshold, findSquares, decode and validation.
+ * The stages are run one after the other with the same parameters and buffers used by ArucoDetector::detect on a whole frame.
+ * @param name Name of the frame set.
+ * @param frames Frames to process.
+ * @param iterations Number of iterations per frame.
+ */
+void benchStages(const string &name, vector<Mat> &frames, int iterations)
+{
+	ArucoDetector detector = ArucoDetector();
+
+	vector<double> gray, thresh, squares, decode, validate, total, detect;
+	unsigned int candidates = 0, found = 0;
+
+	Mat grayscale, binary;
+	vector<vector<Point>> contours;
+	vector<Point> approx;
+	vector<Quadrilateral> quads;
+	vector<ArucoMarker> markers;
+
+	for(unsigned int i = 0; i < frames.size(); i++)
+	{
+		Mat frame = frames[i];
+
+		for(int k = 0; k < iterations; k++)
+		{
+			double t0 = now();
+
+			if(frame.channels() == 1)
+			{
+				grayscale = frame;
+			}
+			else
+			{
+				cvtColor(frame, grayscale, COLOR_BGR2GRAY);
+			}
+
+			double t1 = now();
+
+			adaptiveThreshold(grayscale, binary, 255, THRESH_BINARY, ADAPTIVE_THRESH_MEAN_C, detector.thresholdBlockSize, 0.0);
+
+			double t2 = now();
+
+			unsigned int count = SquareFinder::findSquares(binary, quads, contours, approx, detector.limitCosine, detector.minArea, detector.maxError);
+
+			double t3 = now();
+
+			if(markers.size() < count)
+			{
+				markers.resize(count);
+			}
+
+			for(unsigned int j = 0; j < count; j++)
+			{
+				markers[j] = ArucoMarker();
+				ArucoDetector::sampleArucoData(grayscale, quads[j].points, markers[j], detector.cellSamples);
+			}
+
+			double t4 = now();
+
+			unsigned int valid = 0;
+
+			for(unsigned int j = 0; j < count; j++)
+			{
+				valid += markers[j].validate() ? 1 : 0;
+			}
+
+			double t5 = now();
+
+			gray.push_back(t1 - t0);
+			thresh.push_back(t2 - t1);
+			squares.push_back(t3 - t2);
+			decode.push_back(t4 - t3);
+			validate.push_back(t5 - t4);
+			total.push_back(t5 - t0);
+
+			if(k == 0)
+			{
+				candidates += count;
+				found += valid;
+			}
+		}
+
+		//Full detector call for reference
+		for(int k = 0; k < iterations; k++)
+		{
+			double start = now();
+			detector.detect(frame);
+			detect.push_back(now() - start);
+		}
+	}
+
+	cout << fixed << setprecision(3);
+	cout << name << ": " << frames.size() << " frames, " << candidates << " candidates, " << found << " markers" << endl;
+
+	printStage("gray", gray);
+	printStage("threshold", thresh);
+	printStage("findSquares", squares);
+	printStage("decode", decode);
+	printStage("validate", validate);
+	printStage("total", total);
+	printStage("detect", detect);
+}
+
+/**
+ * Compare the per candidate cost of the warp + resize + Otsu decoder against direct cell sampling.
+ * @param frames Frames used to collect marker candidates.
+ * @param iterations Number of times each candidate is decoded.
+ */
+void benchDecode(const vector<Mat> &frames, int iterations)
+{
+	ArucoDetector detector = ArucoDetector();
+
+	//Collect candidates from all frames
+	vector<Mat> images, grays;
+	vector<vector<Point2f>> candidates;
+	vector<int> owner;
+
+	for(unsigned int i = 0; i < frames.size(); i++)
+	{
+		detector.detect(frames[i]);
+
+		images.push_back(frames[i]);
+		grays.push_back(detector.gray.clone());
+
+		for(unsigned int j = 0; j < detector.quadCount; j++)
+		{
+			candidates.push_back(detector.quads[j].points);
+			owner.push_back(i);
+		}
+	}
+
+	if(candidates.size() == 0)
+	{
+		cout << "No candidates found" << endl;
+		return;
+	}
+
+	ArucoMarker marker = ArucoMarker();
+	Mat board, cells, cellsGray, binary;
+	vector<int> warped = vector<int>(candidates.size(), -1);
+	int agree = 0;
+
+	//Warp + resize + Otsu
+	double start = now();
+
+	for(int k = 0; k < iterations; k++)
+	{
+		for(unsigned int i = 0; i < candidates.size(); i++)
+		{
+			ArucoDetector::deformQuad(images[owner[i]], board, detector.boardCorners, candidates[i]);
+			ArucoDetector::processArucoImage(board, cells, cellsGray, binary);
+			ArucoDetector::readArucoData(binary, marker);
+
+			marker.projected = candidates[i];
+			warped[i] = marker.validate() ? marker.id : -1;
+		}
+	}
+
+	double warpTime = (now() - start) / (iterations * candidates.size());
+
+	cout << "Candidates: " << candidates.size() << ", iterations: " << iterations << endl;
+	cout << fixed << setprecision(3);
+	cout << "warp + resize + otsu: " << warpTime * 1e3 << " us/candidate" << endl;
+
+	//Direct cell sampling with different number of samples per cell
+	for(int samples = 1; samples <= 3; samples++)
+	{
+		agree = 0;
+		start = now();
+
+		for(int k = 0; k < iterations; k++)
+		{
+			for(unsigned int i = 0; i < candidates.size(); i++)
+			{
+				ArucoDetector::sampleArucoData(grays[owner[i]], candidates[i], marker, samples);
+
+				marker.projected = candidates[i];
+				int id = marker.validate() ? marker.id : -1;
+
+				if(k == 0 && id == warped[i])
+				{
+					agree++;
+				}
+			}
+		}
+
+		double sampleTime = (now() - start) / (iterations * candidates.size());
+
+		cout << "sampling " << samples << "x" << samples << ": " << sampleTime * 1e3 << " us/candidate, speedup " << warpTime / sampleTime << "x, agreement " << agree << "/" << candidates.size() << endl;
+	}
+}
+
+/**
+ * Measure how the candidate decode stage scales with the number of threads.
+ * The output of every thread count is compared against the serial output to check that the order is deterministic.
+ * @param frames Frames to process.
+ * @param iterations Number of times each frame is decoded.
+ */
+void benchThreads(const vector<Mat> &frames, int iterations)
+{
+	ArucoDetector detector = ArucoDetector();
+	vector<vector<int>> serial = vector<vector<int>>(frames.size());
+	double base = 0;
+
+	cout << fixed << setprecision(3);
+
+	for(int threads = 1; threads <= getNumberOfCPUs(); threads++)
+	{
+		setNumThreads(threads);
+		detector.threads = threads;
+
+		double total = 0;
+		unsigned int candidates = 0;
+		bool deterministic = true;
+
+		for(unsigned int i = 0; i < frames.size(); i++)
+		{
+			detector.detect(frames[i]);
+			candidates += detector.quadCount;
+
+			double start = now();
+
+			for(int k = 0; k < iterations; k++)
+			{
+				detector.decodeQuads();
+			}
+
+			total += now() - start;
+
+			//Compare ids and order with the serial output
+			vector<int> ids;
+			for(unsigned int j = 0; j < detector.markers.size(); j++)
+			{
+				ids.push_back(detector.markers[j].id);
+			}
+
+			if(threads == 1)
+			{
+				serial[i] = ids;
+			}
+			else if(ids != serial[i])
+			{
+				deterministic = false;
+			}
+		}
+
+		double time = total / (iterations * frames.size());
+
+		if(threads == 1)
+		{
+			base = time;
+		}
+
+		cout << "threads " << threads << ": " << time << " ms/frame (" << candidates / frames.size() << " candidates), speedup " << base / time << "x, " << (deterministic ? "same order" : "ORDER MISMATCH") << endl;
+	}
+}
+
+/**
+ * Count how many of the expected ids were detected.
+ * @param markers Markers detected.
+ * @param ids Expected ids.
+ * @return Number of expected ids found.
+ */
+int countFound(const vector<ArucoMarker> &markers, const vector<int> &ids)
+{
+	int found = 0;
+
+	for(unsigned int i = 0; i < ids.size(); i++)
+	{
+		for(unsigned int j = 0; j < markers.size(); j++)
+		{
+			if(markers[j].id == ids[i])
+			{
+				found++;
+				break;
+			}
+		}
+	}
+
+	return found;
+}
+
+/**
+ * Compare whole frame detection against tiled parallel threshold and quad extraction for 1080p, 4K and 8K frames.
+ * @param rng Random number generator used to create the frames.
+ * @param iterations Number of times each frame is processed.
+ */
+void benchTiles(RNG &rng, int iterations)
+{
+	Size sizes[3] = {Size(1920, 1080), Size(3840, 2160), Size(7680, 4320)};
+	const char *names[3] = {"1080p", "4K", "8K"};
+
+	cout << fixed << setprecision(3);
+
+	for(int s = 0; s < 3; s++)
+	{
+		vector<int> ids;
+		Mat frame = syntheticFrame(sizes[s], 1000, rng, ids, sizes[s].area() / 20000);
+
+		for(int mode = 0; mode < 2; mode++)
+		{
+			ArucoDetector detector = ArucoDetector();
+			detector.tileSize = mode == 0 ? 0 : 512;
+			detector.threads = mode == 0 ? 1 : 0;
+
+			//Warm up buffers
+			detector.detect(frame);
+
+			double start = now();
+
+			for(int k = 0; k < iterations; k++)
+			{
+				detector.detect(frame);
+			}
+
+			double time = (now() - start) / iterations;
+
+			cout << names[s] << " " << (mode == 0 ? "whole frame" : "tiled 512px") << ": " << time << " ms/frame, " << 1000.0 / time << " frames/s, " << detector.quadCount << " quads, " << countFound(detector.markers, ids) << "/" << ids.size() << " markers" << endl;
+		}
+	}
+}
+
+/**
+ * Compare full frame scans against tracking mode on a 1080p sequence where a few markers move some pixels between frames.
+ * @param rng Random generator used to create the frames.
+ * @param iterations Number of frames in the sequence.
+ */
+void benchTracking(RNG &rng, int iterations)
+{
+	vector<int> ids;
+	Mat base = syntheticFrame(Size(1920, 1080), 4, rng, ids);
+
+	//Sequence moving the frame in a circle
+	vector<Mat> sequence;
+
+	for(int k = 0; k < 32; k++)
+	{
+		Mat shift = (Mat_<double>(2, 3) << 1, 0, 12 * cos(k * CV_PI / 16), 0, 1, 12 * sin(k * CV_PI / 16));
+		Mat moved;
+		warpAffine(base, moved, shift, base.size(), INTER_LINEAR, BORDER_REPLICATE);
+		sequence.push_back(moved);
+	}
+
+	cout << fixed << setprecision(3);
+
+	for(int mode = 0; mode < 2; mode++)
+	{
+		ArucoDetector detector = ArucoDetector();
+		detector.tracking = mode == 1;
+
+		detector.detect(sequence[0]);
+
+		int scans = 0;
+		unsigned long found = 0;
+		double start = now();
+
+		for(int k = 0; k < iterations; k++)
+		{
+			detector.detect(sequence[k % sequence.size()]);
+			scans += detector.fullScan ? 1 : 0;
+			found += countFound(detector.markers, ids);
+		}
+
+		double time = (now() - start) / iterations;
+
+		cout << (mode == 0 ? "full frame" : "tracking") << ": " << time << " ms/frame, " << 1000.0 / time << " frames/s, " << scans << "/" << iterations << " full scans, " << (double) found / iterations << "/" << ids.size() << " markers" << endl;
+	}
+}
+
+/**
+ * Compare quad search at full resolution against decimated search on 4K frames with large markers.
+ * @param rng Random generator used to create the frames.
+ * @param iterations Number of iterations.
+ */
+void benchDecimation(RNG &rng, int iterations)
+{
+	vector<int> ids;
+	Mat frame = syntheticFrame(Size(3840, 2160), 40, rng, ids);
+
+	int factors[4] = {1, 2, 4, 0};
+
+	cout << fixed << setprecision(3);
+
+	for(int f = 0; f < 4; f++)
+	{
+		ArucoDetector detector = ArucoDetector(0.7, 7, 2000);
+		detector.decimation = factors[f];
+		detector.detect(frame);
+
+		double start = now();
+
+		for(int k = 0; k < iterations; k++)
+		{
+			detector.detect(frame);
+		}
+
+		double time = (now() - start) / iterations;
+
+		cout << "decimation " << factors[f] << " (using " << detector.scale << "): " << time << " ms/frame, " << 1000.0 / time << " frames/s, " << detector.quadCount << " quads, " << countFound(detector.markers, ids) << "/" << ids.size() << " markers" << endl;
+	}
+}
+
+/**
+ * Compare detection on BGR frames against the same frames as single channel images.
+ * @param frames Frames to process.
+ * @param iterations Number of iterations per frame.
+ */
+void benchMono(vector<Mat> &frames, int iterations)
+{
+	cout << fixed << setprecision(3);
+
+	for(int mode = 0; mode < 2; mode++)
+	{
+		ArucoDetector detector = ArucoDetector();
+		double total = 0;
+		unsigned int found = 0;
+
+		for(unsigned int i = 0; i < frames.size(); i++)
+		{
+			Mat frame;
+
+			if(mode == 1)
+			{
+				cvtColor(frames[i], frame, COLOR_BGR2GRAY);
+			}
+			else
+			{
+				frame = frames[i];
+			}
+
+			detector.detect(frame);
+			found += detector.markers.size();
+
+			double start = now();
+
+			for(int k = 0; k < iterations; k++)
+			{
+				detector.detect(frame);
+			}
+
+			total += now() - start;
+		}
+
+		double time = total / (iterations * frames.size());
+
+		cout << (mode == 0 ? "bgr8" : "mono8") << ": " << time << " ms/frame, " << 1000.0 / time << " frames/s, " << found << " markers" << endl;
+	}
+}
+
+/**
+ * Compare searching several threshold block sizes on one frame, one detection per block size against the shared integral image search (serial and parallel).
+ * Frames are darkened with a lighting gradient so not every block size finds all the markers.
+ * @param rng Random generator used to create the frames.
+ * @param iterations Number of iterations.
+ */
+void benchBlocks(RNG &rng, int iterations)
+{
+	vector<int> ids;
+	Mat frame = syntheticFrame(Size(1920, 1080), 30, rng, ids, 200);
+
+	//Horizontal lighting gradient
+	Mat gradient = Mat(frame.size(), CV_32FC3);
+
+	for(int x = 0; x < frame.cols; x++)
+	{
+		gradient.col(x).setTo(Scalar::all(0.2 + 0.8 * x / frame.cols));
+	}
+
+	frame.convertTo(frame, CV_32FC3);
+	frame = frame.mul(gradient);
+	frame.convertTo(frame, CV_8UC3);
+
+	vector<int> sizes;
+
+	for(int size = 3; size <= 21; size += 2)
+	{
+		sizes.push_back(size);
+	}
+
+	cout << fixed << setprecision(3);
+
+	//One detection per block size
+	{
+		ArucoDetector detector = ArucoDetector();
+		int best = 0, most = -1;
+		double start = now();
+
+		for(int k = 0; k < iterations; k++)
+		{
+			for(unsigned int i = 0; i < sizes.size(); i++)
+			{
+				detector.thresholdBlockSize = sizes[i];
+				detector.detect(frame);
+
+				if(k == 0 && (int) detector.markers.size() > most)
+				{
+					most = detector.markers.size();
+					best = sizes[i];
+				}
+			}
+		}
+
+		double time = (now() - start) / iterations;
+
+		cout << "one detection per block size: " << time << " ms/frame, " << 1000.0 / time << " frames/s, best block " << best << " found " << most << "/" << ids.size() << " markers" << endl;
+	}
+
+	//Shared integral image
+	for(int mode = 0; mode < 2; mode++)
+	{
+		ArucoDetector detector = ArucoDetector();
+		detector.blockSizes = sizes;
+		detector.threads = mode == 0 ? 1 : 0;
+		detector.detect(frame);
+
+		double start = now();
+
+		for(int k = 0; k < iterations; k++)
+		{
+			detector.detect(frame);
+		}
+
+		double time = (now() - start) / iterations;
+
+		cout << "block search " << (mode == 0 ? "serial" : "parallel") << ": " << time << " ms/frame, " << 1000.0 / time << " frames/s, best block " << detector.bestBlockSize << ", " << detector.quadCount << " quads, " << countFound(detector.markers, ids) << "/" << ids.size() << " markers" << endl;
+	}
+}
+
+/**
+ * Check the integral image threshold of the block size search against adaptiveThreshold on a bright 8K frame, whose pixel sum does not fit in 32 bits.
+ * Pixels closer to the border than the block radius are not compared, adaptiveThreshold replicates the border instead of clipping the block.
+ * @param rng Random generator used to create the frame.
+ */
+void checkIntegral(RNG &rng)
+{
+	vector<int> ids;
+	Mat frame = syntheticFrame(Size(7680, 4320), 1000, rng, ids, 1000);
+	frame.convertTo(frame, -1, 0.5, 127.0);
+
+	ArucoDetector detector = ArucoDetector();
+	detector.blockSizes.push_back(7);
+	detector.detect(frame);
+
+	cout << "8K frame sum " << sum(detector.search)[0] << endl;
+
+	for(int size = 3; size <= 21; size += 6)
+	{
+		Mat integralThresh, adaptiveThresh;
+		detector.thresholdIntegral(Rect(0, 0, detector.search.cols, detector.search.rows), size, integralThresh);
+		adaptiveThreshold(detector.search, adaptiveThresh, 255, THRESH_BINARY, ADAPTIVE_THRESH_MEAN_C, size, 0.0);
+
+		int radius = size / 2;
+		Rect inner = Rect(radius, radius, detector.search.cols - 2 * radius, detector.search.rows - 2 * radius);
+		Mat difference;
+		compare(integralThresh(inner), adaptiveThresh(inner), difference, CMP_NE);
+
+		cout << "block " << size << " integral threshold against adaptiveThreshold: " << countNonZero(difference) << " different pixels of " << inner.area() << endl;
+	}
+}
+
+/**
+ * Count the Levenberg-Marquardt iterations needed to converge from an initial pose.
+ * The pose is converged when its reprojection error is within 1e-4 pixels of the error after 100 iterations.
+ * @param world World points.
+ * @param image Projected points.
+ * @param camera Camera calibration matrix.
+ * @param distortion Lenses distortion.
+ * @param rotation Initial rotation.
+ * @param position Initial translation.
+ * @return Number of iterations, -1 if the refinement is not available in this OpenCV version.
+ */
+int iterationsToConverge(const vector<Point3f> &world, const vector<Point2f> &image, Mat camera, Mat distortion, Mat rotation, Mat position)
+{
+	#if POSE_IPPE_SQUARE
+		Mat r = rotation.clone(), t = position.clone();
+		solvePnPRefineLM(world, image, camera, distortion, r, t, TermCriteria(TermCriteria::COUNT, 100, 0));
+		double converged = PoseEstimator::reprojectionError(world, image, camera, distortion, r, t);
+
+		for(int k = 0; k < 30; k++)
+		{
+			r = rotation.clone();
+			t = position.clone();
+
+			if(k > 0)
+			{
+				solvePnPRefineLM(world, image, camera, distortion, r, t, TermCriteria(TermCriteria::COUNT, k, 0));
+			}
+
+			if(PoseEstimator::reprojectionError(world, image, camera, distortion, r, t) - converged < 1e-4)
+			{
+				return k;
+			}
+		}
+
+		return 30;
+	#else
+		(void) world;
+		(void) image;
+		(void) camera;
+		(void) distortion;
+		(void) rotation;
+		(void) position;
+
+		return -1;
+	#endif
+}
+
+/**
+ * Compare the pose solver paths on a smooth camera trajectory observing 1 and 4 markers with 0.3 pixel corner noise.
+ * Reports the solve time per frame, the Levenberg-Marquardt iterations from the initial pose of each path (EPnP for cold starts, the previous pose for warm starts, none for the square solver) and the position error.
+ * @param rng Random generator used for the corner noise.
+ * @param iterations Number of frames in the trajectory.
+ */
+void benchPnP(RNG &rng, int iterations)
+{
+	Mat camera = (Mat_<double>(3, 3) << 570.3, 0, 319.5, 0, 570.3, 239.5, 0, 0, 1);
+	Mat distortion = Mat::zeros(1, 5, CV_64F);
+
+	vector<ArucoMarkerInfo> markers;
+	markers.push_back(ArucoMarkerInfo(0, 0.2, Point3f(0, 0, 0), Point3f(0, 0, 0)));
+	markers.push_back(ArucoMarkerInfo(1, 0.2, Point3f(0.5, 0, 0), Point3f(0, 0, 0.3)));
+	markers.push_back(ArucoMarkerInfo(2, 0.2, Point3f(0, 0.4, 0.1), Point3f(0.2, 0, 0)));
+	markers.push_back(ArucoMarkerInfo(3, 0.2, Point3f(0.5, 0.4, 0), Point3f(0, 0.2, 0)));
+
+	const char *names[3] = {"cold iterative", "warm iterative", "square solver"};
+
+	cout << fixed << setprecision(3);
+
+	for(int count = 1; count <= 4; count += 3)
+	{
+		vector<Point3f> world;
+
+		for(int m = 0; m < count; m++)
+		{
+			world.insert(world.end(), markers[m].world.begin(), markers[m].world.end());
+		}
+
+		//Camera trajectory and noisy projections
+		vector<Mat> rotations, positions;
+		vector<vector<Point2f>> images;
+
+		for(int k = 0; k < iterations; k++)
+		{
+			double a = k * 0.02;
+			Mat rotation = (Mat_<double>(3, 1) << 0.3 * sin(a), 0.3 * cos(a * 0.7), 0.1 * sin(a * 1.3));
+			Mat position = (Mat_<double>(3, 1) << -0.25 + 0.2 * sin(a), -0.2 + 0.1 * cos(a), 2.0 + 0.5 * sin(a * 0.5));
+
+			vector<Point2f> image;
+			projectPoints(world, rotation, position, camera, distortion, image);
+
+			for(unsigned int i = 0; i < image.size(); i++)
+			{
+				image[i] += Point2f(rng.gaussian(0.3), rng.gaussian(0.3));
+			}
+
+			rotations.push_back(rotation);
+			positions.push_back(position);
+			images.push_back(image);
+		}
+
+		for(int path = 0; path < 3; path++)
+		{
+			if(path == 2 && count != 1)
+			{
+				continue;
+			}
+
+			PoseEstimator estimator = PoseEstimator(path == 1, path == 2);
+
+			double start = now();
+
+			for(int k = 0; k < iterations; k++)
+			{
+				estimator.solve(world, images[k], camera, distortion);
+			}
+
+			double time = (now() - start) / iterations;
+
+			//Iterations and error are measured in a second pass so they do not affect the time
+			estimator.reset();
+
+			double error = 0.0;
+			unsigned long steps = 0;
+
+			for(int k = 0; k < iterations; k++)
+			{
+				if(path == 0)
+				{
+					Mat rotation, position;
+
+					#if CV_MAJOR_VERSION == 2
+						solvePnP(world, images[k], camera, distortion, rotation, position, false, EPNP);
+					#else
+						solvePnP(world, images[k], camera, distortion, rotation, position, false, SOLVEPNP_EPNP);
+					#endif
+
+					steps += std::max(iterationsToConverge(world, images[k], camera, distortion, rotation, position), 0);
+				}
+				else if(path == 1 && estimator.valid)
+				{
+					steps += std::max(iterationsToConverge(world, images[k], camera, distortion, estimator.rotation, estimator.position), 0);
+				}
+
+				estimator.solve(world, images[k], camera, distortion);
+				error += norm(estimator.position - positions[k]);
+			}
+
+			cout << count << " marker " << names[path] << ": " << time * 1000.0 << " us/frame, " << (double) steps / iterations << " LM iterations/frame, " << error / iterations * 1000.0 << " mm position error" << endl;
+		}
+	}
+}
+
+/**
+ * Compare findContours against the single pass border follower on thresholded textured frames.
+ * Clutter and a fine noise texture produce many small contours that are not quads, the quads found by both paths are compared.
+ * @param rng Random generator used to create the frames.
+ * @param iterations Number of times each frame is processed.
+ */
+void benchTracer(RNG &rng, int iterations)
+{
+	Size sizes[3] = {Size(1280, 720), Size(1920, 1080), Size(3840, 2160)};
+	const char *names[3] = {"720p", "1080p", "4K"};
+
+	cout << fixed << setprecision(3);
+
+	for(int s = 0; s < 3; s++)
+	{
+		vector<int> ids;
+		Mat frame = syntheticFrame(sizes[s], 20, rng, ids, sizes[s].area() / 10000);
+
+		//Fine texture over the frame
+		Mat noise = Mat(sizes[s], CV_8UC3);
+		randu(noise, Scalar::all(0), Scalar::all(40));
+		frame += noise;
+
+		Mat gray, thresh;
+		cvtColor(frame, gray, COLOR_BGR2GRAY);
+		adaptiveThreshold(gray, thresh, 255, THRESH_BINARY, ADAPTIVE_THRESH_MEAN_C, 7, 0.0);
+
+		vector<Quadrilateral> quads, traced;
+		vector<vector<Point>> contours;
+		vector<Point> approx;
+		ContourTracer tracer;
+
+		unsigned int quadCount = SquareFinder::findSquares(thresh, quads, contours, approx, 0.7, 100, 0.025);
+		unsigned int tracedCount = tracer.findSquares(thresh, traced, 0.7, 100, 0.025);
+
+		//Both paths should find the same quads in the same order
+		bool same = quadCount == tracedCount;
+
+		for(unsigned int i = 0; i < quadCount && same; i++)
+		{
+			for(int j = 0; j < 4; j++)
+			{
+				same = same && quads[i].points[j] == traced[i].points[j];
+			}
+		}
+
+		double start = now();
+
+		for(int k = 0; k < iterations; k++)
+		{
+			SquareFinder::findSquares(thresh, quads, contours, approx, 0.7, 100, 0.025);
+		}
+
+		double contoursTime = (now() - start) / iterations;
+
+		start = now();
+
+		for(int k = 0; k < iterations; k++)
+		{
+			tracer.findSquares(thresh, traced, 0.7, 100, 0.025);
+		}
+
+		double tracerTime = (now() - start) / iterations;
+
+		cout << names[s] << " findContours: " << contoursTime << " ms/frame, " << contours.size() << " contours, " << quadCount << " quads" << endl;
+		cout << names[s] << " border follower: " << tracerTime << " ms/frame, " << tracer.stats.contours << " contours (" << tracer.stats.filtered() << " discarded before approximation), " << tracedCount << " quads, speedup " << contoursTime / tracerTime << "x, " << (same ? "same quads" : "QUAD MISMATCH") << endl;
+	}
+}
+
+/**
+ * Compare the flat contour list against the hierarchy pruning of the children of accepted dark quads.
+ * Marker cells and the light centers of the clutter squares are children of a dark quad and are pruned before approximation.
+ * @param rng Random generator used to create the frames.
+ * @param iterations Number of times each frame is processed.
+ */
+void benchPrune(RNG &rng, int iterations)
+{
+	Size sizes[3] = {Size(1280, 720), Size(1920, 1080), Size(3840, 2160)};
+	const char *names[3] = {"720p", "1080p", "4K"};
+
+	cout << fixed << setprecision(3);
+
+	for(int s = 0; s < 3; s++)
+	{
+		vector<int> ids;
+		Mat frame = syntheticFrame(sizes[s], 20, rng, ids, sizes[s].area() / 10000);
+
+		for(int mode = 0; mode < 2; mode++)
+		{
+			ArucoDetector detector = ArucoDetector();
+			detector.pruneChildren = mode == 1;
+			detector.threads = 1;
+
+			//Warm up buffers
+			detector.detect(frame);
+
+			double start = now();
+
+			for(int k = 0; k < iterations; k++)
+			{
+				detector.detect(frame);
+			}
+
+			double time = (now() - start) / iterations;
+			const SquareFinder::Stats &stats = detector.squareStats;
+
+			cout << names[s] << " " << (mode == 0 ? "contour list" : "pruned tree") << ": " << time << " ms/frame, " << countFound(detector.markers, ids) << "/" << ids.size() << " markers, " << detector.quadCount << " quads" << endl;
+			cout << "  " << stats.contours << " contours, " << stats.pruned << " pruned, " << stats.filtered() << " filtered, rejected " << stats.vertices << " vertices, " << stats.area << " area, " << stats.convex << " convex, " << stats.angle << " angle, " << stats.squares << " squares" << endl;
+		}
+	}
+}
+
+/**
+ * Test every contour with the polygon approximation first, as the quad search did before the cheap filters.
+ * @param contours Contours to test.
+ * @param approx Polygon approximation buffer.
+ * @param limitCosine Limit value for cosine in the quad corners.
+ * @param minArea Minimum area of the quad.
+ * @param maxError Max error percentage relative to the square perimeter.
+ * @return Number of quads found.
+ */
+unsigned int approximateAll(const vector<vector<Point>> &contours, vector<Point> &approx, double limitCosine, int minArea, double maxError)
+{
+	unsigned int count = 0;
+
+	for(unsigned int i = 0; i < contours.size(); i++)
+	{
+		approxPolyDP(Mat(contours[i]), approx, arcLength(Mat(contours[i]), true) * maxError, true);
+
+		if(approx.size() != 4 || fabs(contourArea(Mat(approx))) <= minArea || !isContourConvex(Mat(approx)))
+		{
+			continue;
+		}
+
+		float maxCosine = 0;
+
+		for(int j = 2; j < 5; j++)
+		{
+			maxCosine = MAX(maxCosine, (float) fabs(SquareFinder::angleCornerPointsCos(approx[j%4], approx[j-2], approx[j-1])));
+		}
+
+		if(maxCosine < limitCosine)
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Measure how many contours each quad check rejects and the cost of testing the contours with and without the cheap filters before the polygon approximation.
+ * @param name Name of the frame set.
+ * @param frames Frames to process.
+ * @param iterations Number of times each frame is processed.
+ */
+void benchFilters(const string &name, const vector<Mat> &frames, int iterations)
+{
+	SquareFinder::Stats stats, total;
+	vector<vector<Point>> contours;
+	vector<Point> approx;
+	double approximateTime = 0.0, filterTime = 0.0;
+	unsigned int approximated = 0, filtered = 0;
+
+	for(unsigned int f = 0; f < frames.size(); f++)
+	{
+		Mat gray, thresh;
+		cvtColor(frames[f], gray, COLOR_BGR2GRAY);
+		adaptiveThreshold(gray, thresh, 255, THRESH_BINARY, ADAPTIVE_THRESH_MEAN_C, 7, 0.0);
+		findContours(thresh, contours, RETR_LIST, CHAIN_APPROX_SIMPLE);
+
+		double start = now();
+
+		for(int k = 0; k < iterations; k++)
+		{
+			approximated = approximateAll(contours, approx, 0.7, 100, 0.025);
+		}
+
+		approximateTime += (now() - start) / iterations;
+
+		start = now();
+
+		for(int k = 0; k < iterations; k++)
+		{
+			stats.reset();
+			filtered = 0;
+
+			for(unsigned int i = 0; i < contours.size(); i++)
+			{
+				filtered += SquareFinder::isSquare(contours[i], approx, 0.7, 100, 0.025, SquareFinder::MAX_ASPECT, stats);
+			}
+		}
+
+		filterTime += (now() - start) / iterations;
+
+		stats.contours = contours.size();
+		total.add(stats);
+
+		if(approximated != filtered)
+		{
+			cout << name << " frame " << f << ": QUAD MISMATCH " << approximated << " approximating all, " << filtered << " filtered" << endl;
+		}
+	}
+
+	cout << name << " approximate all: " << approximateTime / frames.size() << " ms/frame, filtered: " << filterTime / frames.size() << " ms/frame, speedup " << approximateTime / filterTime << "x" << endl;
+	cout << "  " << total.contours << " contours, rejected " << total.points << " points, " << total.small << " small, " << total.aspect << " aspect, " << total.perimeter << " perimeter (" << 100.0 * total.filtered() / std::max(total.contours, 1u) << "% before approximation), " << total.vertices << " vertices, " << total.area << " area, " << total.convex << " convex, " << total.angle << " angle, " << total.squares << " squares" << endl;
+}
+
+/**
+ * Compare decoding every quad against decoding one quad per group of duplicates, with a single block size and with the block size search.
+ * The quiet zone and the threshold rings around each marker produce several nested quads of the same square.
+ * @param rng Random generator used to create the frames.
+ * @param iterations Number of times each frame is processed.
+ */
+void benchDuplicates(RNG &rng, int iterations)
+{
+	vector<int> ids;
+	Mat frame = syntheticFrame(Size(1920, 1080), 40, rng, ids, 200);
+
+	vector<int> blockSizes;
+
+	for(int size = 3; size <= 21; size += 2)
+	{
+		blockSizes.push_back(size);
+	}
+
+	cout << fixed << setprecision(3);
+
+	for(int search = 0; search < 2; search++)
+	{
+		for(int mode = 0; mode < 2; mode++)
+		{
+			ArucoDetector detector = ArucoDetector();
+			detector.suppressDuplicates = mode == 1;
+
+			if(search == 1)
+			{
+				detector.blockSizes = blockSizes;
+			}
+
+			//Warm up buffers
+			detector.detect(frame);
+
+			double start = now();
+
+			for(int k = 0; k < iterations; k++)
+			{
+				detector.detect(frame);
+			}
+
+			double time = (now() - start) / iterations;
+
+			cout << (search == 0 ? "single block" : "block search") << " " << (mode == 0 ? "decode all" : "suppressed") << ": " << time << " ms/frame, decode " << detector.decodeTime << " ms, " << detector.quadCount << " quads, " << detector.candidateCount << " decoded, " << detector.markers.size() << " markers, " << countFound(detector.markers, ids) << "/" << ids.size() << " ids" << endl;
+		}
+	}
+}
+
+/**
+ * Compare the quad backends on the same frames, clean, with a fine noise texture and with horizontal motion blur.
+ * Reports the time, the contours (or blobs) found, the quads decoded and the recall of the expected markers of each backend.
+ * @param rng Random generator used to create the frames.
+ * @param iterations Number of times each frame is processed.
+ */
+void benchBackends(RNG &rng, int iterations)
+{
+	const char *sets[3] = {"clean", "textured", "blurred"};
+	vector<Mat> frames[3];
+	vector<vector<int>> frameIds;
+
+	for(int i = 0; i < 4; i++)
+	{
+		vector<int> ids;
+		Mat frame = syntheticFrame(Size(1920, 1080), 20, rng, ids, 200);
+		frameIds.push_back(ids);
+
+		Mat noise = Mat(frame.size(), CV_8UC3), textured;
+		randu(noise, Scalar::all(0), Scalar::all(40));
+		add(frame, noise, textured);
+
+		//9 pixels of horizontal motion
+		Mat blurred;
+		blur(frame, blurred, Size(9, 1));
+
+		frames[0].push_back(frame);
+		frames[1].push_back(textured);
+		frames[2].push_back(blurred);
+	}
+
+	cout << fixed << setprecision(3);
+
+	for(int set = 0; set < 3; set++)
+	{
+		for(int b = 0; b < BACKEND_COUNT; b++)
+		{
+			ArucoDetector detector = ArucoDetector();
+			detector.backend = (QuadBackend) b;
+
+			double time = 0.0;
+			unsigned int contours = 0, decoded = 0, found = 0, expected = 0;
+
+			for(unsigned int i = 0; i < frames[set].size(); i++)
+			{
+				//Warm up buffers
+				detector.detect(frames[set][i]);
+
+				double start = now();
+
+				for(int k = 0; k < iterations; k++)
+				{
+					detector.detect(frames[set][i]);
+				}
+
+				time += (now() - start) / iterations;
+				contours += detector.squareStats.contours;
+				decoded += detector.candidateCount;
+				found += countFound(detector.markers, frameIds[i]);
+				expected += frameIds[i].size();
+			}
+
+			unsigned int count = frames[set].size();
+
+			cout << sets[set] << " " << SquareFinder::backendName((QuadBackend) b) << ": " << time / count << " ms/frame, " << contours / count << " contours, " << decoded / count << " decoded, recall " << found << "/" << expected << " (" << 100.0 * found / std::max(expected, 1u) << "%)" << endl;
+		}
+	}
+}
+
+/**
+ * Compare registering a marker map one marker at a time against a single batch, the full dictionary is loaded.
+ * A second batch repeats every id several times to measure the cost of replacing markers already registered.
+ * @param rng Random generator used for the marker positions.
+ * @param iterations Number of times each map is loaded.
+ */
+void benchLoad(RNG &rng, int iterations)
+{
+	//Marker infos are created before timing, the corner calculation is the same for every path
+	vector<ArucoMarkerInfo> map, repeated;
+
+	for(int i = 0; i < ArucoMarkerRegistry::IDS; i++)
+	{
+		map.push_back(ArucoMarkerInfo(i, 0.15, Point3d(rng.uniform(-10.0, 10.0), rng.uniform(-10.0, 10.0), 0), Point3d(0, 0, rng.uniform(0.0, CV_PI))));
+	}
+
+	for(int i = 0; i < 4 * ArucoMarkerRegistry::IDS; i++)
+	{
+		repeated.push_back(map[rng.uniform(0, ArucoMarkerRegistry::IDS)]);
+	}
+
+	const char *names[3] = {"one by one", "batch add", "batch replace"};
+
+	cout << fixed << setprecision(3);
+
+	for(int batch = 0; batch < 2; batch++)
+	{
+		const vector<ArucoMarkerInfo> &infos = batch == 0 ? map : repeated;
+
+		for(int path = 0; path < 3; path++)
+		{
+			double total = 0.0;
+			size_t registered = 0;
+
+			for(int k = 0; k < iterations; k++)
+			{
+				ArucoMarkerRegistry registry;
+
+				double start = now();
+
+				if(path == 0)
+				{
+					for(unsigned int i = 0; i < infos.size(); i++)
+					{
+						registry.add(infos[i]);
+					}
+				}
+				else if(path == 1)
+				{
+					registry.add(infos);
+				}
+				else
+				{
+					registry.replace(infos);
+				}
+
+				total += now() - start;
+				registered = registry.snapshot()->size();
+			}
+
+			cout << infos.size() << " entries " << names[path] << ": " << total / iterations << " ms/load, " << registered << " markers registered" << endl;
+		}
+	}
+}
+
+/**
+ * Load the png images of a directory.
+ * @param directory Directory with the images.
+ * @return Images loaded as BGR, images that can not be read are skipped.
+ */
+vector<Mat> loadImages(const string &directory)
+{
+	vector<String> files;
+	glob(directory + "/*.png", files);
+
+	vector<Mat> loaded;
+
+	for(unsigned int i = 0; i < files.size(); i++)
+	{
+		Mat image = imread(files[i], IMREAD_COLOR);
+
+		if(!image.empty())
+		{
+			loaded.push_back(image);
+		}
+	}
+
+	return loaded;
+}
+
+/**
+ * Benchmark for the aruco detector, does not depend on ROS.
+ * Usage: aruco_bench [mode] [iterations] [images]
+ * Modes:
+ *  - stages: latency percentiles and throughput of each pipeline stage over the repository images and synthetic frames (default).
+ *  - decode: per candidate decode cost, warp + resize + Otsu against direct cell sampling.
+ *  - threads: candidate decode scaling from 1 to N threads on cluttered frames.
+ *  - tiles: whole frame against tiled parallel threshold and contours for 1080p, 4K and 8K frames.
+ *  - tracking: full frame scans against tracking mode on a sequence of moving markers.
+ *  - decimation: full resolution against downscaled quad search on 4K frames.
+ *  - mono: BGR frames against single channel frames.
+ *  - blocks: one detection per threshold block size against the block size search on a shared integral image, and a check of the integral threshold against adaptiveThreshold at 8K.
+ *  - pnp: pose solver cost and iterations, cold and warm started iterative solver against the square solver.
+ *  - load: marker map registration one marker at a time against a single batch.
+ *  - tracer: findContours against the single pass border follower on textured frames.
+ *  - prune: flat contour list against hierarchy pruning, with the contours rejected by each quad check.
+ *  - filters: contours rejected by each quad check, and the cost of the checks with and without the filters before the polygon approximation.
+ *  - duplicates: decoding every quad against decoding one quad per group of nested duplicates.
+ *  - backends: speed and recall of each quad backend on clean, textured and motion blurred frames.
+ * @param argc Number of arguments.
+ * @param argv Value of the arguments.
+ */
+int main(int argc, char **argv)
+{
+	string mode = argc > 1 ? argv[1] : "stages";
+	int iterations = argc > 2 ? stoi(argv[2]) : 100;
+	string images = argc > 3 ? argv[3] : ARUCO_IMAGES;
+
+	RNG rng = RNG(0x1234);
+	vector<int> ids;
+	vector<Mat> frames;
+
+	for(int i = 0; i < 8; i++)
+	{
+		frames.push_back(syntheticFrame(Size(1280, 720), 12, rng, ids));
+	}
+
+	if(mode == "stages")
+	{
+		//Repository images
+		vector<Mat> loaded = loadImages(images);
+
+		if(loaded.empty())
+		{
+			cerr << "No images found in " << images << endl;
+		}
+		else
+		{
+			benchStages("images", loaded, iterations);
+		}
+
+		//Synthetic frames at several resolutions
+		Size sizes[4] = {Size(640, 480), Size(1280, 720), Size(1920, 1080), Size(3840, 2160)};
+
+		for(int s = 0; s < 4; s++)
+		{
+			vector<Mat> synthetic;
+
+			for(int i = 0; i < 4; i++)
+			{
+				synthetic.push_back(syntheticFrame(sizes[s], 20, rng, ids, sizes[s].area() / 20000));
+			}
+
+			benchStages(to_string(sizes[s].width) + "x" + to_string(sizes[s].height), synthetic, iterations);
+		}
+	}
+	else if(mode == "decode")
+	{
+		benchDecode(frames, iterations);
+	}
+	else if(mode == "threads")
+	{
+		vector<Mat> cluttered;
+
+		for(int i = 0; i < 4; i++)
+		{
+			cluttered.push_back(syntheticFrame(Size(1920, 1080), 16, rng, ids, 400));
+		}
+
+		benchThreads(cluttered, iterations);
+	}
+	else if(mode == "tiles")
+	{
+		benchTiles(rng, iterations);
+	}
+	else if(mode == "tracking")
+	{
+		benchTracking(rng, iterations);
+	}
+	else if(mode == "decimation")
+	{
+		benchDecimation(rng, iterations);
+	}
+	else if(mode == "mono")
+	{
+		benchMono(frames, iterations);
+	}
+	else if(mode == "blocks")
+	{
+		benchBlocks(rng, iterations);
+		checkIntegral(rng);
+	}
+	else if(mode == "pnp")
+	{
+		benchPnP(rng, iterations);
+	}
+	else if(mode == "load")
+	{
+		benchLoad(rng, iterations);
+	}
+	else if(mode == "tracer")
+	{
+		benchTracer(rng, iterations);
+	}
+	else if(mode == "prune")
+	{
+		benchPrune(rng, iterations);
+	}
+	else if(mode == "backends")
+	{
+		benchBackends(rng, iterations);
+	}
+	else if(mode == "duplicates")
+	{
+		benchDuplicates(rng, iterations);
+	}
+	else if(mode == "filters")
+	{
+		vector<Mat> loaded = loadImages(images);
+
+		if(!loaded.empty())
+		{
+			benchFilters("images", loaded, iterations);
+		}
+
+		//Textured frames with many small noise contours
+		vector<Mat> textured;
+
+		for(int i = 0; i < 4; i++)
+		{
+			Mat frame = syntheticFrame(Size(1920, 1080), 20, rng, ids, 200);
+			Mat noise = Mat(frame.size(), CV_8UC3);
+			randu(noise, Scalar::all(0), Scalar::all(40));
+			frame += noise;
+			textured.push_back(frame);
+		}
+
+		benchFilters("1920x1080 textured", textured, iterations);
+	}
+	else
+	{
+		cerr << "Unknown mode " << mode << endl;
+		return 1;
+	}
+
+	return 0;
+}
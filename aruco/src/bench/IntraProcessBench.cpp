@@ -0,0 +1,308 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <memory>
+
+#include <opencv2/core/core.hpp>
+
+#include "rclcpp/rclcpp.hpp"
+#include "std_msgs/msg/bool.hpp"
+#include "sensor_msgs/image_encodings.hpp"
+#include "sensor_msgs/msg/image.hpp"
+
+#include "ament_index_cpp/get_resource.hpp"
+#include "class_loader/class_loader.hpp"
+#include "rclcpp_components/node_factory.hpp"
+
+#include "aruco/msg/pipeline_stats.hpp"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Get current time in milliseconds from a monotonic clock.
+ * @return Time in milliseconds.
+ */
+double now()
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Node that publishes full resolution images as unique pointers, the same way a camera driver component does.
+ */
+class ImageSource : public rclcpp::Node
+{
+	public:
+		rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr publisher;
+
+		/**
+		 * Image copied into every message.
+		 */
+		Mat frame;
+
+		/**
+		 * Address of the data of each published message, used to check if the subscribers got the same buffer.
+		 */
+		vector<const uint8_t*> pointers;
+
+		ImageSource(const rclcpp::NodeOptions &options, Size size, unsigned int count) : Node("aruco_bench_source", options)
+		{
+			publisher = create_publisher<sensor_msgs::msg::Image>("/rgb/image", 10);
+
+			frame = Mat(size, CV_8UC3);
+			randu(frame, Scalar::all(0), Scalar::all(255));
+
+			pointers.resize(count, nullptr);
+		}
+
+		/**
+		 * Publish a new image message.
+		 * @param index Index of the message, stored in the header frame id.
+		 */
+		void publish(unsigned int index)
+		{
+			sensor_msgs::msg::Image::UniquePtr msg(new sensor_msgs::msg::Image());
+			msg->header.frame_id = to_string(index);
+			msg->width = frame.cols;
+			msg->height = frame.rows;
+			msg->encoding = sensor_msgs::image_encodings::BGR8;
+			msg->is_bigendian = 0;
+			msg->step = frame.cols * 3;
+			msg->data.assign(frame.data, frame.data + frame.total() * 3);
+
+			pointers[index] = msg->data.data();
+			publisher->publish(std::move(msg));
+		}
+};
+
+/**
+ * Node that counts the images received and how many of them share the memory of the published message.
+ */
+class ImageProbe : public rclcpp::Node
+{
+	public:
+		rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr subscription;
+		ImageSource *source;
+
+		atomic<unsigned long> received;
+		atomic<unsigned long> shared;
+
+		ImageProbe(const rclcpp::NodeOptions &options, ImageSource *_source) : Node("aruco_bench_probe", options)
+		{
+			source = _source;
+			received = 0;
+			shared = 0;
+
+			subscription = create_subscription<sensor_msgs::msg::Image>("/rgb/image", 10, [this](sensor_msgs::msg::Image::UniquePtr msg)
+			{
+				unsigned int index = stoul(msg->header.frame_id);
+
+				if(index < source->pointers.size() && msg->data.data() == source->pointers[index])
+				{
+					shared++;
+				}
+
+				received++;
+			});
+		}
+};
+
+/**
+ * Node that counts the frames processed by the aruco node from its visible topic (published once per frame) and reads the frames it received from its pipeline stats.
+ */
+class ArucoProbe : public rclcpp::Node
+{
+	public:
+		rclcpp::Subscription<std_msgs::msg::Bool>::SharedPtr subscription_visible;
+		rclcpp::Subscription<aruco::msg::PipelineStats>::SharedPtr subscription_stats;
+
+		atomic<unsigned long> processed;
+		atomic<unsigned long> received;
+
+		ArucoProbe(const rclcpp::NodeOptions &options) : Node("aruco_bench_node_probe", options)
+		{
+			processed = 0;
+			received = 0;
+
+			subscription_visible = create_subscription<std_msgs::msg::Bool>("/visible", 100, [this](const std_msgs::msg::Bool::SharedPtr)
+			{
+				processed++;
+			});
+
+			subscription_stats = create_subscription<aruco::msg::PipelineStats>("/pipeline_stats", 10, [this](const aruco::msg::PipelineStats::SharedPtr msg)
+			{
+				received = msg->frames_received;
+			});
+		}
+};
+
+/**
+ * Find the library of a component in the ament index, the same way a component container does.
+ * @param package Package that registered the component.
+ * @param plugin Name of the component class.
+ * @return Path of the library, empty if the component is not registered.
+ */
+string componentLibrary(const string &package, const string &plugin)
+{
+	string content, prefix;
+
+	if(!ament_index_cpp::get_resource("rclcpp_components", package, content, &prefix))
+	{
+		return "";
+	}
+
+	//Each line is the component class and its library separated by a semicolon
+	stringstream lines(content);
+	string line;
+
+	while(getline(lines, line))
+	{
+		size_t separator = line.find(';');
+
+		if(separator != string::npos && line.substr(0, separator) == plugin)
+		{
+			string library = line.substr(separator + 1);
+			return library.size() > 0 && library[0] == '/' ? library : prefix + "/" + library;
+		}
+	}
+
+	return "";
+}
+
+/**
+ * Publish images to the subscriber nodes keeping at most a few messages in flight.
+ * @param source Image source.
+ * @param subscribers Nodes that receive the images, spun with the source in their own executor thread.
+ * @param received Counter of images received by the subscribers.
+ * @param count Number of images to publish.
+ * @param settle Time in milliseconds the nodes keep spinning after the run (not measured).
+ * @return Time elapsed in milliseconds.
+ */
+double run(shared_ptr<ImageSource> source, const vector<rclcpp::node_interfaces::NodeBaseInterface::SharedPtr> &subscribers, atomic<unsigned long> &received, unsigned int count, int settle = 0)
+{
+	rclcpp::executors::SingleThreadedExecutor executor;
+	executor.add_node(source);
+
+	for(unsigned int i = 0; i < subscribers.size(); i++)
+	{
+		executor.add_node(subscribers[i]);
+	}
+
+	thread spin([&executor](){executor.spin();});
+
+	//Wait for discovery
+	this_thread::sleep_for(chrono::milliseconds(500));
+
+	double start = now();
+
+	for(unsigned int i = 0; i < count; i++)
+	{
+		source->publish(i);
+
+		//Keep at most 8 images in flight, messages lost are skipped after a timeout
+		double deadline = now() + 1000.0;
+
+		while(received + 8 <= i && now() < deadline)
+		{
+			this_thread::sleep_for(chrono::microseconds(50));
+		}
+	}
+
+	double deadline = now() + 1000.0;
+
+	while(received < count && now() < deadline)
+	{
+		this_thread::sleep_for(chrono::microseconds(50));
+	}
+
+	double time = now() - start;
+
+	this_thread::sleep_for(chrono::milliseconds(settle));
+
+	executor.cancel();
+	spin.join();
+
+	return time;
+}
+
+/**
+ * Measure the image throughput from a camera like publisher to a subscriber in the same process.
+ * Compares intra process communication (messages moved as unique pointers) against the DDS path (messages serialized).
+ * The aruco node is loaded from the installed ArucoNode component library, the same way a component container loads it.
+ * Usage: aruco_intra_bench [frames] [width] [height]
+ * @param argc Number of arguments.
+ * @param argv Value of the arguments.
+ */
+int main(int argc, char **argv)
+{
+	rclcpp::init(argc, argv);
+
+	unsigned int count = argc > 1 ? stoi(argv[1]) : 300;
+	Size size = Size(argc > 2 ? stoi(argv[2]) : 1920, argc > 3 ? stoi(argv[3]) : 1080);
+	double megabytes = size.area() * 3 / 1e6;
+
+	string library = componentLibrary("aruco", "ArucoNode");
+
+	if(library == "")
+	{
+		cout << "ArucoNode component not found, source the aruco package install." << endl;
+		rclcpp::shutdown();
+		return 1;
+	}
+
+	//The loader is kept until every node created from the library is destroyed
+	class_loader::ClassLoader loader(library);
+	shared_ptr<rclcpp_components::NodeFactory> factory = loader.createInstance<rclcpp_components::NodeFactory>("rclcpp_components::NodeFactoryTemplate<ArucoNode>");
+
+	cout << fixed << setprecision(2);
+
+	for(int intra = 1; intra >= 0; intra--)
+	{
+		rclcpp::NodeOptions options = rclcpp::NodeOptions().use_intra_process_comms(intra == 1);
+		string name = intra == 1 ? "intra process" : "dds";
+
+		//Transport only
+		{
+			shared_ptr<ImageSource> source = make_shared<ImageSource>(options, size, count);
+			shared_ptr<ImageProbe> probe = make_shared<ImageProbe>(options, source.get());
+
+			double time = run(source, {probe->get_node_base_interface()}, probe->received, count);
+			double fps = probe->received * 1000.0 / time;
+
+			cout << name << " probe: " << fps << " frames/s, " << fps * megabytes << " MB/s, " << probe->received << "/" << count << " received";
+
+			//In the DDS path the published buffer is released after serialization so its address can be reused
+			if(intra == 1)
+			{
+				cout << ", " << probe->shared << " without copy";
+			}
+
+			cout << endl;
+		}
+
+		//Aruco node, the queues hold every image in flight so the frames are processed without drops
+		{
+			shared_ptr<ImageSource> source = make_shared<ImageSource>(options, size, count);
+			shared_ptr<ArucoProbe> probe = make_shared<ArucoProbe>(options);
+
+			rclcpp::NodeOptions node_options = rclcpp::NodeOptions(options).append_parameter_override("queue_size", 8);
+			rclcpp_components::NodeInstanceWrapper node = factory->create_node_instance(node_options);
+
+			//The pipeline stats are published every second, the last ones count the frames received in the whole run
+			double time = run(source, {node.get_node_base_interface(), probe->get_node_base_interface()}, probe->processed, count, 1500);
+			double fps = probe->processed * 1000.0 / time;
+
+			cout << name << " maruco: " << fps << " frames/s processed, " << fps * megabytes << " MB/s, " << probe->received << "/" << count << " received, " << probe->processed << " processed" << endl;
+		}
+	}
+
+	rclcpp::shutdown();
+
+	return 0;
+}
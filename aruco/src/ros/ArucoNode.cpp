@@ -1,5 +1,10 @@
 #include <iostream>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <condition_variable>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -16,602 +21,831 @@
 #include "geometry_msgs/msg/point.hpp"
 #include "geometry_msgs/msg/pose_stamped.hpp"
 #include "sensor_msgs/image_encodings.hpp"
+#include "sensor_msgs/msg/image.hpp"
+#include "sensor_msgs/msg/compressed_image.hpp"
+#include "sensor_msgs/msg/camera_info.hpp"
 
-#include "image_transport/image_transport.h"
 #include "cv_bridge/cv_bridge.h"
+#include "rclcpp_components/register_node_macro.hpp"
 
 #include "aruco/msg/marker.hpp"
+#include "aruco/msg/pipeline_stats.hpp"
+#include "aruco/msg/frame_diagnostics.hpp"
+#include "aruco/msg/marker_array.hpp"
+#include "aruco/srv/load_markers.hpp"
 
-#include "../ArucoMarker.cpp"
-#include "../ArucoMarkerInfo.cpp"
-#include "../ArucoDetector.cpp"
+#include "CameraContext.cpp"
 
 using namespace cv;
 using namespace std;
 
 /**
- * Camera calibration matrix pre initialized with calibration values for the test camera.
- */
-double data_calibration[9] = {570.3422241210938, 0, 319.5, 0, 570.3422241210938, 239.5, 0, 0, 1};
-Mat calibration;
-
-/**
- * Lenses distortion matrix initialized with values for the test camera.
+ * Draw yellow text with black outline into a frame.
+ * @param frame Frame mat.
+ * @param text Text to be drawn into the frame.
+ * @param point Position of the text in frame coordinates.
  */
-double data_distortion[5] = {0, 0, 0, 0, 0};
-Mat distortion;
+void drawText(Mat frame, string text, Point point)
+{
+	putText(frame, text, point, FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 0, 0), 2, CV_AA);
+	putText(frame, text, point, FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 255, 255), 1, CV_AA);
+}
 
 /**
- * List of known of markers, to get the absolute position and rotation of the camera, some of these are required.
+ * Aruco ROS node, the node gets image and calibration parameters from camera, and publishes position and rotation of the camera relative to the markers.
+ * The node is a rclcpp component, it can be loaded into the same container as the camera driver to receive images without copies or launched with the maruco executable.
+ * A single node can process several cameras, each camera keeps its own calibration and detector state while the known markers are shared, the stages of all cameras run on one worker pool.
+ * Units should be in meters and radians, the markers are described by a position and an euler rotation.
+ * Position is also available as a pose message that should be easier to consume by other ROS nodes.
+ * Its possible to pass markers as arugment to this node or register and remove them during runtime using another ROS node.
+ * The coordinate system used by OpenCV uses Z+ to represent depth, Y- for height and X+ for lateral, but for the node the coordinate system used is diferent X+ for depth, Z+ for height and Y- for lateral movement.
+ * The coordinates are converted on input and on output, its possible to force the OpenCV coordinate system by setting the use_opencv_coords param to true.
+ *   
+ *           ROS          |          OpenCV
+ *    Z+                  |    Y- 
+ *    |                   |    |
+ *    |    X+             |    |    Z+
+ *    |    /              |    |    /
+ *    |   /               |    |   /
+ *    |  /                |    |  /
+ *    | /                 |    | /
+ *    |/                  |    |/
+ *    O-------------> Y-  |    O-------------> X+
  */
-vector<ArucoMarkerInfo> known = vector<ArucoMarkerInfo>();
+class ArucoNode : public rclcpp::Node
+{
+	public:
+		/**
+		 * Cameras processed by the node.
+		 */
+		vector<unique_ptr<CameraContext>> cameras;
+
+		/**
+		 * Registry of known of markers, to get the absolute position and rotation of the camera, some of these are required.
+		 * The registry is shared by all the cameras, frames read a snapshot of the registry so the register and remove callbacks do not block the pipeline.
+		 */
+		ArucoMarkerRegistry known;
+
+		/**
+		 * Pose publisher sequence counter.
+		 */
+		int pub_pose_seq;
+
+		/**
+		 * Flag to determine if OpenCV or ROS coordinates are used.
+		 */
+		bool use_opencv_coords;
+
+		/**
+		 * When debug parameter is se to true the node creates a new cv window to show debug information.
+		 * By default is set to false.
+		 * If set true the node will open a debug window for each camera.
+		 */
+		bool debug;
+
+		/**
+		 * Transport used to receive the camera images, "raw" or "compressed".
+		 * Compressed images are received from the topic_camera/compressed topic and decoded by the ingest stage.
+		 * By default "raw" is used.
+		 */
+		string image_transport;
+
+		/**
+		 * Capacity of the queues between the pipeline stages.
+		 * By default 1 is used (only the latest frame is kept).
+		 */
+		int queue_size;
+
+		/**
+		 * Number of threads of the worker pool that runs the pipeline stages of all the cameras.
+		 * By default 4 is used (one per stage).
+		 */
+		int workers;
+
+		/**
+		 * Number of frames received and published by all the cameras.
+		 */
+		atomic<unsigned long> frames_received;
+		atomic<unsigned long> frames_published;
+
+		/**
+		 * Protects the camera stage busy flags and the round robin cursor, workers wait on work_available when no stage is ready.
+		 */
+		mutex schedule_mutex;
+		condition_variable work_available;
+
+		/**
+		 * Camera where the next search for work starts, so every camera gets its turn.
+		 */
+		unsigned int schedule_cursor;
+
+		/**
+		 * False when the node is being destroyed and the workers should stop.
+		 */
+		bool running;
+
+		/**
+		 * Serializes the debug windows, HighGUI can only be used from one thread at a time.
+		 */
+		mutex debug_mutex;
+
+		/**
+		 * Pipeline statistics publisher.
+		 */
+		rclcpp::Publisher<aruco::msg::PipelineStats>::SharedPtr pub_pipeline_stats;
+
+		/**
+		 * Subscriptions of the node.
+		 */
+		rclcpp::Subscription<aruco::msg::Marker>::SharedPtr sub_marker_register;
+		rclcpp::Subscription<aruco::msg::MarkerArray>::SharedPtr sub_marker_array;
+		rclcpp::Subscription<std_msgs::msg::Int32>::SharedPtr sub_marker_remove;
+
+		/**
+		 * Service used to load a whole marker map at once.
+		 */
+		rclcpp::Service<aruco::srv::LoadMarkers>::SharedPtr srv_load_markers;
+
+		/**
+		 * Timer used to publish the pipeline statistics.
+		 */
+		rclcpp::TimerBase::SharedPtr timer_pipeline_stats;
+
+		/**
+		 * Threads of the worker pool.
+		 */
+		vector<thread> worker_threads;
+
+		/**
+		 * Create the node, read the parameters, create the cameras and start the worker pool.
+		 * @param options Node options, parameters are declared automatically from the overrides.
+		 */
+		ArucoNode(const rclcpp::NodeOptions &options = rclcpp::NodeOptions()) : Node("maruco", rclcpp::NodeOptions(options).automatically_declare_parameters_from_overrides(true))
+		{
+			//Parameters
+			get_parameter_or<bool>("debug", debug, false);
+			get_parameter_or<bool>("use_opencv_coords", use_opencv_coords, false);
+			get_parameter_or<int>("queue_size", queue_size, 1);
+			get_parameter_or<int>("workers", workers, 4);
+			get_parameter_or<string>("image_transport", image_transport, "raw");
+
+			pub_pose_seq = 0;
+			frames_received = 0;
+			frames_published = 0;
+			schedule_cursor = 0;
+			running = true;
+
+			//Subscribed topic names
+			string topic_camera, topic_camera_info, topic_marker_register, topic_marker_array, topic_marker_remove, service_load_markers;
+			get_parameter_or<string>("topic_camera", topic_camera, "/rgb/image");
+			get_parameter_or<string>("topic_camera_info", topic_camera_info, "/rgb/camera_info");
+			get_parameter_or<string>("topic_marker_register", topic_marker_register, "/marker_register");
+			get_parameter_or<string>("topic_marker_array", topic_marker_array, "/marker_array");
+			get_parameter_or<string>("topic_marker_remove", topic_marker_remove, "/marker_remove");
+			get_parameter_or<string>("service_load_markers", service_load_markers, "/load_markers");
+
+			//Camera list, topic_camera is used if no list is provided
+			vector<string> topic_cameras, topic_camera_infos;
+			get_parameter_or<vector<string>>("topic_cameras", topic_cameras, vector<string>());
+			get_parameter_or<vector<string>>("topic_camera_infos", topic_camera_infos, vector<string>());
+
+			if(topic_cameras.size() == 0)
+			{
+				topic_cameras.push_back(topic_camera);
+				topic_camera_infos = vector<string>(1, topic_camera_info);
+			}
 
-/**
- * ROS node visibility publisher.
- * Publishes true when a known marker is visible, publishes false otherwise.
- */
-rclcpp::Publisher<std_msgs::msg::Bool>::SharedPtr pub_visible;
+			//Publish topic names
+			string topic_visible, topic_position, topic_rotation, topic_pose, topic_pipeline_stats, topic_frame_diagnostics;
+			get_parameter_or<string>("topic_visible", topic_visible, "/visible");
+			get_parameter_or<string>("topic_position", topic_position, "/position");
+			get_parameter_or<string>("topic_rotation", topic_rotation, "/rotation");
+			get_parameter_or<string>("topic_pose", topic_pose, "/pose");
+			get_parameter_or<string>("topic_pipeline_stats", topic_pipeline_stats, "/pipeline_stats");
+			get_parameter_or<string>("topic_frame_diagnostics", topic_frame_diagnostics, "/frame_diagnostics");
+
+			//Create the cameras
+			for(unsigned int c = 0; c < topic_cameras.size(); c++)
+			{
+				CameraContext *camera = new CameraContext(c, topic_cameras[c], std::max(queue_size, 1));
+				cameras.push_back(unique_ptr<CameraContext>(camera));
 
-/**
- * ROS node position publisher.
- */
-rclcpp::Publisher<geometry_msgs::msg::Point>::SharedPtr pub_position;
+				//Detector, pose and calibration parameters
+				camera->readParameters(*this);
+			}
 
-/**
- * ROS node rotation publisher.
- */
-rclcpp::Publisher<geometry_msgs::msg::Point>::SharedPtr pub_rotation;
+			//Aruco makers passed as parameters
+			readMarkerParameters(*this, known, use_opencv_coords);
 
-/**
- * ROS node pose publisher.
- */
-rclcpp::Publisher<geometry_msgs::msg::PoseStamped>::SharedPtr pub_pose;
+			//Print all known markers
+			if(debug)
+			{
+				known.print();
+			}
 
-/**
- * Pose publisher sequence counter.
- */
-int pub_pose_seq = 0;
+			for(unsigned int c = 0; c < cameras.size(); c++)
+			{
+				std::cout << "camera: " << cameras[c]->topic << std::endl;
+			}
 
-/**
- * Flag to check if calibration parameters were received.
- * If set to false the camera will be calibrated when a camera info message is received.
- */
-bool calibrated;
+			std::cout << "marker_register: " << topic_marker_register << std::endl << "marker_remove:" << topic_marker_remove << std::endl
+					<< "topic_visible: " << topic_visible << std::endl << "topic_position: " << topic_position << std::endl;
 
-/**
- * Flag to determine if OpenCV or ROS coordinates are used.
- */
-bool use_opencv_coords;
+			//Advertise topics, with more than one camera the output topics of each camera are placed in the camera namespace
+			pub_pipeline_stats = create_publisher<aruco::msg::PipelineStats>(topic_pipeline_stats, 10);
 
-/**
- * When debug parameter is se to true the node creates a new cv window to show debug information.
- * By default is set to false.
- * If set true the node will open a debug window.
- */
-bool debug;
+			for(unsigned int c = 0; c < cameras.size(); c++)
+			{
+				CameraContext *camera = cameras[c].get();
+				string prefix = cameras.size() > 1 ? cameraNamespace(camera->topic) : "";
 
-/**
- * Cosine limit used during the quad detection phase.
- * Value between 0 and 1.
- * By default 0.8 is used.
- * The bigger the value more distortion tolerant the square detection will be.
- */
-float cosine_limit;
+				camera->pub_visible = create_publisher<std_msgs::msg::Bool>(prefix + topic_visible, 10);
+				camera->pub_position = create_publisher<geometry_msgs::msg::Point>(prefix + topic_position, 10);
+				camera->pub_rotation = create_publisher<geometry_msgs::msg::Point>(prefix + topic_rotation, 10);
+				camera->pub_pose = create_publisher<geometry_msgs::msg::PoseStamped>(prefix + topic_pose, 10);
 
-/**
- * Maximum error to be used by geometry poly aproximation method in the quad detection phase.
- * By default 0.035 is used.
- */
-float max_error_quad;
+				#if ARUCO_PROFILE
+					camera->pub_frame_diagnostics = create_publisher<aruco::msg::FrameDiagnostics>(prefix + topic_frame_diagnostics, 10);
+				#endif
+			}
 
-/**
- * Adaptive theshold pre processing block size.
- */
-int theshold_block_size;
+			//Worker pool
+			for(int i = 0; i < std::max(workers, 1); i++)
+			{
+				worker_threads.push_back(thread(&ArucoNode::workerLoop, this));
+			}
 
-/**
- * Minimum threshold block size.
- * By default 5 is used.
- */
-int theshold_block_size_min;
+			timer_pipeline_stats = create_wall_timer(std::chrono::seconds(1), [this](){onPipelineStats();});
 
-/**
- * Maximum threshold block size.
- * By default 9 is used.
- */
-int theshold_block_size_max;
+			//Subscribe topics
+			for(unsigned int c = 0; c < cameras.size(); c++)
+			{
+				CameraContext *camera = cameras[c].get();
+				string topic_info = c < topic_camera_infos.size() ? topic_camera_infos[c] : cameraNamespace(camera->topic) + "/camera_info";
 
-/**
- * Minimum area considered for aruco markers.
- * Should be a value high enough to filter blobs out but detect the smallest marker necessary.
- * By default 100 is used.
- */
-int min_area;
+				if(image_transport == "compressed")
+				{
+					camera->sub_compressed = create_subscription<sensor_msgs::msg::CompressedImage>(camera->topic + "/compressed", 10, [this, camera](sensor_msgs::msg::CompressedImage::UniquePtr msg){onCompressedFrame(*camera, std::move(msg));});
+				}
+				else
+				{
+					camera->sub_image = create_subscription<sensor_msgs::msg::Image>(camera->topic, 10, [this, camera](sensor_msgs::msg::Image::UniquePtr msg){onFrame(*camera, std::move(msg));});
+				}
 
-/**
- * Draw yellow text with black outline into a frame.
- * @param frame Frame mat.
- * @param text Text to be drawn into the frame.
- * @param point Position of the text in frame coordinates.
- */
-void drawText(Mat frame, string text, Point point)
-{
-	putText(frame, text, point, FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 0, 0), 2, CV_AA);
-	putText(frame, text, point, FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 255, 255), 1, CV_AA);
-}
+				camera->sub_camera_info = create_subscription<sensor_msgs::msg::CameraInfo>(topic_info, 10, [this, camera](const sensor_msgs::msg::CameraInfo::SharedPtr msg){onCameraInfo(*camera, msg);});
+			}
 
-/**
- * Callback executed every time a new camera frame is received.
- * This callback is used to process received images and publish messages with camera position data if any.
- */
-void onFrame(const sensor_msgs::msg::Image::SharedPtr msg)
-{
-	try
-	{
-		
-		Mat frame = cv_bridge::toCvShare(msg, "bgr8")->image;
+			sub_marker_register = create_subscription<aruco::msg::Marker>(topic_marker_register, 10, [this](const aruco::msg::Marker::SharedPtr msg){onMarkerRegister(msg);});
+			sub_marker_array = create_subscription<aruco::msg::MarkerArray>(topic_marker_array, 10, [this](const aruco::msg::MarkerArray::SharedPtr msg){onMarkerArray(msg);});
+			sub_marker_remove = create_subscription<std_msgs::msg::Int32>(topic_marker_remove, 10, [this](const std_msgs::msg::Int32::SharedPtr msg){onMarkerRemove(msg);});
 
-		//Process image and get markers
-		vector<ArucoMarker> markers = ArucoDetector::getMarkers(frame, cosine_limit, theshold_block_size, min_area, max_error_quad);
+			//Services
+			srv_load_markers = create_service<aruco::srv::LoadMarkers>(service_load_markers, [this](const shared_ptr<aruco::srv::LoadMarkers::Request> request, shared_ptr<aruco::srv::LoadMarkers::Response> response){onLoadMarkers(request, response);});
+		}
 
+		/**
+		 * Stop the worker pool, frames still queued are discarded.
+		 */
+		~ArucoNode()
+		{
+			{
+				lock_guard<mutex> guard(schedule_mutex);
+				running = false;
+			}
 
-		//Visible
-		vector<ArucoMarker> found;
+			work_available.notify_all();
 
-		//Vector of points
-		vector<Point2f> projected;
-		vector<Point3f> world;
+			for(unsigned int i = 0; i < worker_threads.size(); i++)
+			{
+				worker_threads[i].join();
+			}
+		}
 
-		if(markers.size() == 0)
+		/**
+		 * Get the namespace of a camera from its image topic, "/front/rgb/image" is in the "/front/rgb" namespace.
+		 * @param topic Camera image topic.
+		 * @return Camera namespace.
+		 */
+		static string cameraNamespace(string topic)
 		{
-			theshold_block_size += 2;
+			size_t pos = topic.find_last_of('/');
+			return pos == string::npos ? "" : topic.substr(0, pos);
+		}
 
-			if(theshold_block_size > theshold_block_size_max)
+		/**
+		 * Wake up a worker after a frame was queued.
+		 * The schedule mutex is acquired so the notification is not lost by a worker that is about to wait.
+		 */
+		void notifyWork()
+		{
 			{
-				theshold_block_size = theshold_block_size_min;
+				lock_guard<mutex> guard(schedule_mutex);
 			}
+
+			work_available.notify_one();
 		}
 
-		//Check known markers and build known of points
-		for(unsigned int i = 0; i < markers.size(); i++)
+		/**
+		 * Worker pool thread, runs one stage of one camera at a time.
+		 * Cameras are visited in round robin order so every camera gets the same share of the workers, inside a camera the later stages run first so frames in flight finish before new frames start.
+		 * Each stage of a camera is run by one worker at a time, so the frames of a camera keep their order and the detector is never shared.
+		 */
+		void workerLoop()
 		{
-            //std::cerr << "got marker: " << markers[i].id << " markers " << std::endl;
-            for(unsigned int j = 0; j < known.size(); j++)
+			unique_lock<mutex> guard(schedule_mutex);
+
+			while(running)
 			{
-				if(markers[i].id == known[j].id)
+				CameraContext *camera = nullptr;
+				int stage = 0;
+
+				for(unsigned int k = 0; k < cameras.size() && camera == nullptr; k++)
 				{
-					markers[i].attachInfo(known[j]);
-					
-					for(unsigned int k = 0; k < 4; k++)
+					CameraContext *candidate = cameras[(schedule_cursor + k) % cameras.size()].get();
+
+					for(int s = STAGE_COUNT - 1; s >= 0; s--)
 					{
-						projected.push_back(markers[i].projected[k]);
-						world.push_back(known[j].world[k]);
+						if(!candidate->busy[s] && candidate->pending(s))
+						{
+							camera = candidate;
+							stage = s;
+							break;
+						}
 					}
+				}
 
-					found.push_back(markers[i]);
+				if(camera == nullptr)
+				{
+					work_available.wait(guard);
+					continue;
+				}
+
+				schedule_cursor = (camera->index + 1) % cameras.size();
+				camera->busy[stage] = true;
+				guard.unlock();
+
+				if(stage == STAGE_INGEST)
+				{
+					if(image_transport == "compressed")
+					{
+						decodeStage(*camera);
+					}
+					else
+					{
+						ingestStage(*camera);
+					}
+				}
+				else if(stage == STAGE_DETECT)
+				{
+					detectStage(*camera);
+				}
+				else if(stage == STAGE_POSE)
+				{
+					poseStage(*camera);
 				}
+				else
+				{
+					publishStage(*camera);
+				}
+
+				guard.lock();
+				camera->busy[stage] = false;
 			}
 		}
 
-		//Draw markers
-		if(debug)
+		/**
+		 * Callback executed every time a new camera frame is received.
+		 * The message is received as a unique pointer so intra process messages are moved into the pipeline without copying.
+		 * The message is only queued, the processing is done by the worker pool so the callback never blocks the executor.
+		 * @param camera Camera that received the frame.
+		 */
+		void onFrame(CameraContext &camera, sensor_msgs::msg::Image::UniquePtr msg)
 		{
-			ArucoDetector::drawMarkers(frame, markers, calibration, distortion);
+			frames_received++;
+			camera.ingest_queue.push(sensor_msgs::msg::Image::SharedPtr(std::move(msg)));
+			notifyWork();
 		}
 
-		//Check if any marker was found
-		if(world.size() > 0)
+		/**
+		 * Callback executed every time a new compressed camera frame is received.
+		 * The decoding is done by the ingest stage so it overlaps with the detection of the previous frame.
+		 * @param camera Camera that received the frame.
+		 */
+		void onCompressedFrame(CameraContext &camera, sensor_msgs::msg::CompressedImage::UniquePtr msg)
 		{
-			//Calculate position and rotation
-			Mat rotation, position;
+			frames_received++;
+			camera.compressed_queue.push(sensor_msgs::msg::CompressedImage::SharedPtr(std::move(msg)));
+			notifyWork();
+		}
 
-			#if CV_MAJOR_VERSION == 2
-				solvePnP(world, projected, calibration, distortion, rotation, position, false, ITERATIVE);
-			#else
-				solvePnP(world, projected, calibration, distortion, rotation, position, false, SOLVEPNP_ITERATIVE);
-			#endif
+		/**
+		 * Ingest stage for compressed images, decodes the JPEG or PNG data of a frame to an OpenCV image.
+		 * Grayscale images are kept single channel so the detector does not need to convert them.
+		 * @param camera Camera to process.
+		 */
+		void decodeStage(CameraContext &camera)
+		{
+			sensor_msgs::msg::CompressedImage::SharedPtr msg;
 
-			//Invert position and rotation to get camera coords
-			Mat rodrigues;
-			Rodrigues(rotation, rodrigues);
-			
-			Mat camera_rotation;
-			Rodrigues(rodrigues.t(), camera_rotation);
-			
-			Mat camera_position = -rodrigues.t() * position;
-
-			//Publish position and rotation
-            geometry_msgs::msg::Point message_position, message_rotation;
-
-			//Opencv coordinates
-			if(use_opencv_coords)
-			{
-				message_position.x = camera_position.at<double>(0, 0);
-				message_position.y = camera_position.at<double>(1, 0);
-				message_position.z = camera_position.at<double>(2, 0);
-				
-				message_rotation.x = camera_rotation.at<double>(0, 0);
-				message_rotation.y = camera_rotation.at<double>(1, 0);
-				message_rotation.z = camera_rotation.at<double>(2, 0);
-			}
-			//Robot coordinates
-			else
+			if(!camera.compressed_queue.tryPop(msg))
 			{
-				message_position.x = camera_position.at<double>(2, 0);
-				message_position.y = -camera_position.at<double>(0, 0);
-				message_position.z = -camera_position.at<double>(1, 0);
-				
-				message_rotation.x = camera_rotation.at<double>(2, 0);
-				message_rotation.y = -camera_rotation.at<double>(0, 0);
-				message_rotation.z = -camera_rotation.at<double>(1, 0);
+				return;
 			}
 
-            pub_position->publish(message_position);
-            pub_rotation->publish(message_rotation);
-
-			//Publish pose
-            geometry_msgs::msg::PoseStamped message_pose;
+			shared_ptr<PipelineFrame> frame = PipelineFrame::fromCompressed(msg);
 
-			//Header
-			message_pose.header.frame_id = "aruco";
-            //message_pose.header.seq = pub_pose_seq++;
-            using builtin_interfaces::msg::Time;
-            rclcpp::Clock ros_clock(RCL_ROS_TIME);
-            Time ros_now = ros_clock.now();
-            message_pose.header.stamp = ros_now;
-
-			//Position
-			message_pose.pose.position.x = message_position.x;
-			message_pose.pose.position.y = message_position.y;
-			message_pose.pose.position.z = message_position.z;
+			if(frame == nullptr)
+			{
+				return;
+			}
 
-			//Convert to quaternion
-			double x = message_rotation.x;
-			double y = message_rotation.y;
-			double z = message_rotation.z;
+			camera.detect_queue.push(frame);
+			notifyWork();
+		}
 
-			//Module of angular velocity
-			double angle = sqrt(x*x + y*y + z*z);
+		/**
+		 * Ingest stage, converts an image message to an OpenCV image.
+		 * @param camera Camera to process.
+		 */
+		void ingestStage(CameraContext &camera)
+		{
+			sensor_msgs::msg::Image::SharedPtr msg;
 
-			if(angle > 0.0)
-			{
-				message_pose.pose.orientation.x = x * sin(angle/2.0)/angle;
-				message_pose.pose.orientation.y = y * sin(angle/2.0)/angle;
-				message_pose.pose.orientation.z = z * sin(angle/2.0)/angle;
-				message_pose.pose.orientation.w = cos(angle/2.0);
-			}
-			//To avoid illegal expressions
-			else
+			if(!camera.ingest_queue.tryPop(msg))
 			{
-				message_pose.pose.orientation.x = 0.0;
-				message_pose.pose.orientation.y = 0.0;
-				message_pose.pose.orientation.z = 0.0;
-				message_pose.pose.orientation.w = 1.0;
+				return;
 			}
-			
-            pub_pose->publish(message_pose);
 
-			//Debug
-			if(debug)
+			shared_ptr<PipelineFrame> frame = PipelineFrame::fromImage(msg);
+
+			if(frame == nullptr)
 			{
-                ArucoDetector::drawOrigin(frame, found, calibration, distortion, 0.3);
-				
-				drawText(frame, "Position: " + to_string(message_position.x) + ", " + to_string(message_position.y) + ", " + to_string(message_position.z), Point2f(10, 180));
-				drawText(frame, "Rotation: " + to_string(message_rotation.x) + ", " + to_string(message_rotation.y) + ", " + to_string(message_rotation.z), Point2f(10, 200));
+				return;
 			}
-		}
-		else if(debug)
-		{
-			drawText(frame, "Position: unknown", Point2f(10, 180));
-			drawText(frame, "Rotation: unknown", Point2f(10, 200));
-		}
 
-		//Publish visible
-        std_msgs::msg::Bool message_visible;
-		message_visible.data = world.size() != 0;
-        pub_visible->publish(message_visible);
+			camera.detect_queue.push(frame);
+			notifyWork();
+		}
 
-		//Debug info
-		if(debug)
+		/**
+		 * Apply a key pressed in the debug window to the detector parameters of a camera.
+		 * @param camera Camera of the debug window.
+		 * @param key Key pressed.
+		 */
+		void applyDebugKey(CameraContext &camera, char key)
 		{
-			drawText(frame, "Aruco ROS Debug", Point2f(10, 20));
-			drawText(frame, "OpenCV V" + to_string(CV_MAJOR_VERSION) + "." + to_string(CV_MINOR_VERSION), Point2f(10, 40));
-			drawText(frame, "Cosine Limit (A-Q): " + to_string(cosine_limit), Point2f(10, 60));
-			drawText(frame, "Threshold Block (W-S): " + to_string(theshold_block_size), Point2f(10, 80));
-			drawText(frame, "Min Area (E-D): " + to_string(min_area), Point2f(10, 100));
-			drawText(frame, "MaxError PolyDP (R-F): " + to_string(max_error_quad), Point2f(10, 120));
-			drawText(frame, "Visible: " + to_string(message_visible.data), Point2f(10, 140));
-			drawText(frame, "Calibrated: " + to_string(calibrated), Point2f(10, 160));
-
-			imshow("Aruco", frame);
-
-			char key = (char) waitKey(1);
-
 			if(key == 'q')
 			{
-				cosine_limit += 0.05;
+				camera.cosine_limit += 0.05;
 			}
 			else if(key == 'a')
 			{
-				cosine_limit -= 0.05;
+				camera.cosine_limit -= 0.05;
 			}
 
 			if(key == 'w')
 			{
-				theshold_block_size += 2;
+				camera.theshold_block_size += 2;
 			}
-			else if(key == 's' && theshold_block_size > 3)
+			else if(key == 's' && camera.theshold_block_size > 3)
 			{
-				theshold_block_size -= 2;
+				camera.theshold_block_size -= 2;
 			}
 
 			if(key == 'r')
 			{
-				max_error_quad += 0.005;
+				camera.max_error_quad += 0.005;
 			}
 			else if(key == 'f')
 			{
-				max_error_quad -= 0.005;
+				camera.max_error_quad -= 0.005;
 			}
 
 			if(key == 'e')
 			{
-				min_area += 50;
+				camera.min_area += 50;
 			}
 			else if(key == 'd')
 			{
-				min_area -= 50;
+				camera.min_area -= 50;
 			}
 		}
-	}
-	catch(cv_bridge::Exception& e)
-	{
-        std::cerr << "Error getting image data" << std::endl;
-	}
-}
 
-/**
- * On camera info callback.
- * Used to receive camera calibration parameters.
- */
-void onCameraInfo(const sensor_msgs::msg::CameraInfo::SharedPtr msg)
-{
-	if(!calibrated)
-	{
-		calibrated = true;
-		
-		for(unsigned int i = 0; i < 9; i++)
+		/**
+		 * Detect stage, finds the markers in a frame of a camera.
+		 * This is the only stage that uses the camera detector and its parameters.
+		 * @param camera Camera to process.
+		 */
+		void detectStage(CameraContext &camera)
 		{
-            calibration.at<double>(i / 3, i % 3) = msg->k[i];
+			shared_ptr<PipelineFrame> frame;
+
+			if(!camera.detect_queue.tryPop(frame))
+			{
+				return;
+			}
+
+			applyDebugKey(camera, (char) camera.debug_key.exchange(-1));
+
+			camera.detect(*frame);
+
+			camera.pose_queue.push(frame);
+			notifyWork();
 		}
-		
-		for(unsigned int i = 0; i < 5; i++)
+
+		/**
+		 * Pose stage, calculates the camera pose from the known markers visible in a frame.
+		 * @param camera Camera to process.
+		 */
+		void poseStage(CameraContext &camera)
 		{
-            distortion.at<double>(0, i) = msg->d[i];
+			shared_ptr<PipelineFrame> frame;
+
+			if(!camera.pose_queue.tryPop(frame))
+			{
+				return;
+			}
+
+			//Pose messages are stamped with the node clock
+			rclcpp::Clock ros_clock(RCL_ROS_TIME);
+			camera.solvePose(*frame, *known.snapshot(), ros_clock.now());
+
+			camera.publish_queue.push(frame);
+			notifyWork();
 		}
 
-		if(debug)
+		/**
+		 * Draw the debug information of a frame and show it in the debug window of the camera.
+		 * @param camera Camera of the frame.
+		 * @param data Frame processed by the pipeline.
+		 */
+		void drawDebug(CameraContext &camera, PipelineFrame &data)
 		{
-			cout << "Camera calibration param received" << endl;
-			cout << "Camera: " << calibration << endl;
-			cout << "Distortion: " << distortion << endl;
+			//Debug drawing is done over a color version of the image
+			Mat frame = data.image;
+
+			if(frame.channels() == 1)
+			{
+				cvtColor(data.image, frame, COLOR_GRAY2BGR);
+			}
+
+			Mat calibration, distortion;
+			bool calibrated;
+
+			{
+				lock_guard<mutex> guard(camera.calibration_mutex);
+				calibration = camera.calibration.clone();
+				distortion = camera.distortion.clone();
+				calibrated = camera.calibrated;
+			}
+
+			ArucoDetector::drawMarkers(frame, data.markers, calibration, distortion);
+
+			if(data.visible)
+			{
+				ArucoDetector::drawOrigin(frame, data.found, calibration, distortion, data.world_rotation, data.world_position, 0.3);
+
+				drawText(frame, "Position: " + to_string(data.position.x) + ", " + to_string(data.position.y) + ", " + to_string(data.position.z), Point2f(10, 180));
+				drawText(frame, "Rotation: " + to_string(data.rotation.x) + ", " + to_string(data.rotation.y) + ", " + to_string(data.rotation.z), Point2f(10, 200));
+			}
+			else
+			{
+				drawText(frame, "Position: unknown", Point2f(10, 180));
+				drawText(frame, "Rotation: unknown", Point2f(10, 200));
+			}
+
+			drawText(frame, "Aruco ROS Debug", Point2f(10, 20));
+			drawText(frame, "OpenCV V" + to_string(CV_MAJOR_VERSION) + "." + to_string(CV_MINOR_VERSION), Point2f(10, 40));
+			drawText(frame, "Cosine Limit (A-Q): " + to_string(data.cosine_limit), Point2f(10, 60));
+			drawText(frame, "Threshold Block (W-S): " + to_string(data.block_size), Point2f(10, 80));
+			drawText(frame, "Min Area (E-D): " + to_string(data.min_area), Point2f(10, 100));
+			drawText(frame, "MaxError PolyDP (R-F): " + to_string(data.max_error_quad), Point2f(10, 120));
+			drawText(frame, "Visible: " + to_string(data.visible), Point2f(10, 140));
+			drawText(frame, "Calibrated: " + to_string(calibrated), Point2f(10, 160));
+
+			lock_guard<mutex> guard(debug_mutex);
+
+			imshow(cameras.size() > 1 ? "Aruco " + camera.topic : "Aruco", frame);
+
+			//Keys are applied by the detect stage
+			int key = waitKey(1);
+
+			if(key >= 0)
+			{
+				camera.debug_key.store(key);
+			}
 		}
-	}
-}
 
-/**
- * Callback to register markers on the marker list.
- * This callback received a custom marker message.
- */
-void onMarkerRegister(const aruco::msg::Marker::SharedPtr msg)
-{
-	for(unsigned int i = 0; i < known.size(); i++)
-	{
-        if(known[i].id == msg->id)
+		/**
+		 * Publish stage, publishes the pose messages of a frame and shows the debug window.
+		 * @param camera Camera to process.
+		 */
+		void publishStage(CameraContext &camera)
 		{
-			known.erase(known.begin() + i);
-            cout << "Marker " << to_string(msg->id) << " already exists, was replaced." << endl;
-			break;
-		}
-	}
+			shared_ptr<PipelineFrame> frame;
 
-    known.push_back(ArucoMarkerInfo(msg->id, msg->size, Point3d(msg->posx, msg->posy, msg->posz), Point3d(msg->rotx, msg->roty, msg->rotz)));
-    cout << "Marker " << to_string(msg->id) << " added." << endl;
-}
+			if(!camera.publish_queue.tryPop(frame))
+			{
+				return;
+			}
 
-/**
- * Callback to remove markers from the marker list.
- * Markers are removed by publishing the remove ID to the remove topic.
- */
-void onMarkerRemove(const std_msgs::msg::Int32::SharedPtr msg)
-{
-	for(unsigned int i = 0; i < known.size(); i++)
-	{
-        if(known[i].id == msg->data)
-		{
-			known.erase(known.begin() + i);
-            cout << "Marker " << to_string(msg->data) << " removed." << endl;
-			break;
-		}
-	}
-}
+			#if ARUCO_PROFILE
+				double time = StageTimer::now();
+			#endif
 
-/**
- * Converts a string with numeric values separated by a delimiter to an array of double values.
- * If 0_1_2_3 and delimiter is _ array will contain {0, 1, 2, 3}.
- * @param data String to be converted
- * @param values Array to store values on
- * @param cout Number of elements in the string
- * @param delimiter Separator element
- * @return Array with values.
- */
-void stringToDoubleArray(string data, double* values, unsigned int count, string delimiter)
-{
-	unsigned int pos = 0, k = 0;
-
-	while((pos = data.find(delimiter)) != string::npos && k < count)
-	{
-		string token = data.substr(0, pos);
-		values[k] = stod(token);
-		data.erase(0, pos + delimiter.length());
-		k++;
-	}
-}
+			if(frame->visible)
+			{
+				camera.pub_position->publish(frame->position);
+				camera.pub_rotation->publish(frame->rotation);
+				camera.pub_pose->publish(frame->pose);
+			}
 
-/**
- * Main method launches aruco ros node, the node gets image and calibration parameters from camera, and publishes position and rotation of the camera relative to the markers.
- * Units should be in meters and radians, the markers are described by a position and an euler rotation.
- * Position is also available as a pose message that should be easier to consume by other ROS nodes.
- * Its possible to pass markers as arugment to this node or register and remove them during runtime using another ROS node.
- * The coordinate system used by OpenCV uses Z+ to represent depth, Y- for height and X+ for lateral, but for the node the coordinate system used is diferent X+ for depth, Z+ for height and Y- for lateral movement.
- * The coordinates are converted on input and on output, its possible to force the OpenCV coordinate system by setting the use_opencv_coords param to true.
- *   
- *           ROS          |          OpenCV
- *    Z+                  |    Y- 
- *    |                   |    |
- *    |    X+             |    |    Z+
- *    |    /              |    |    /
- *    |   /               |    |   /
- *    |  /                |    |  /
- *    | /                 |    | /
- *    |/                  |    |/
- *    O-------------> Y-  |    O-------------> X+
- *
- * @param argc Number of arguments.
- * @param argv Value of the arguments.
- */
-int main(int argc, char **argv)
-{
-    rclcpp::init(argc, argv);
-
-	//ROS node instance
-    auto opts = rclcpp::NodeOptions().automatically_declare_parameters_from_overrides(true);
-    rclcpp::Node::SharedPtr node = std::make_shared<rclcpp::Node>("maruco", opts);
-	
-	//Parameters
-    node->get_parameter_or<bool>("debug", debug, false);
-    node->get_parameter_or<bool>("use_opencv_coords", use_opencv_coords, false);
-    node->get_parameter_or<float>("cosine_limit", cosine_limit, 0.7);
-    node->get_parameter_or<int>("theshold_block_size_min", theshold_block_size_min, 3);
-    node->get_parameter_or<int>("theshold_block_size_max", theshold_block_size_max, 21);
-    node->get_parameter_or<float>("max_error_quad", max_error_quad, 0.035);
-    node->get_parameter_or<int>("min_area", min_area, 100);
-    node->get_parameter_or<bool>("calibrated", calibrated, false);
-
-	//Initial threshold block size
-	theshold_block_size = (theshold_block_size_min + theshold_block_size_max) / 2;
-	if(theshold_block_size % 2 == 0)
-	{
-		theshold_block_size++;
-	}
-
-	//Initialize calibration matrices
-	calibration = Mat(3, 3, CV_64F, data_calibration);
-	distortion = Mat(1, 5, CV_64F, data_distortion);
-
-	//Camera instrinsic calibration parameters
-    string data;
-    node->get_parameter_or<string>("calibration",data,"");
-    if(data != "")
-	{
-		double values[9];
-		stringToDoubleArray(data, values, 9, "_");
-
-		for(unsigned int i = 0; i < 9; i++)
-		{
-			calibration.at<double>(i / 3, i % 3) = values[i];
-		}
+			//Publish visible
+			std_msgs::msg::Bool message_visible;
+			message_visible.data = frame->visible;
+			camera.pub_visible->publish(message_visible);
 
-		calibrated = true;
-	}
+			frames_published++;
 
-	//Camera distortion calibration parameters
-    node->get_parameter_or<string>("distortion",data,"");
-    if(data != "")
-	{
-		string data;
+			#if ARUCO_PROFILE
+				frame->publish_time = StageTimer::now() - time;
+				publishDiagnostics(camera, *frame);
+			#endif
 
-		double values[5];
-		stringToDoubleArray(data, values, 5, "_");
+			if(debug)
+			{
+				drawDebug(camera, *frame);
+			}
+		}
 
-		for(unsigned int i = 0; i < 5; i++)
+		/**
+		 * Publish the stage times, counts and image age of a frame after its pose was published.
+		 * The age is measured with the node clock, so the camera stamps should use the same time source.
+		 * @param camera Camera of the frame.
+		 * @param frame Frame processed by the pipeline.
+		 */
+		void publishDiagnostics(CameraContext &camera, const PipelineFrame &frame)
 		{
-			distortion.at<double>(0, i) = values[i];
+			aruco::msg::FrameDiagnostics message;
+
+			message.header.stamp = frame.stamp;
+			message.header.frame_id = "aruco";
+
+			message.conversion_time = frame.conversion_time;
+			message.threshold_time = frame.threshold_time;
+			message.contours_time = frame.contours_time;
+			message.decode_time = frame.decode_time;
+			message.pnp_time = frame.pnp_time;
+			message.publish_time = frame.publish_time;
+
+			message.candidates = frame.candidates;
+			message.markers = frame.markers.size();
+			message.known_markers = frame.found.size();
+
+			message.contours = frame.square_stats.contours;
+			message.pruned_contours = frame.square_stats.pruned;
+			message.small_contours = frame.square_stats.small;
+			message.rejected_fill = frame.square_stats.fill;
+			message.rejected_points = frame.square_stats.points;
+			message.rejected_aspect = frame.square_stats.aspect;
+			message.rejected_perimeter = frame.square_stats.perimeter;
+			message.rejected_vertices = frame.square_stats.vertices;
+			message.rejected_area = frame.square_stats.area;
+			message.rejected_convex = frame.square_stats.convex;
+			message.rejected_angle = frame.square_stats.angle;
+
+			message.age = (now().nanoseconds() - rclcpp::Time(frame.stamp).nanoseconds()) / 1e6;
+
+			camera.pub_frame_diagnostics->publish(message);
 		}
 
-		calibrated = true;
-	}
+		/**
+		 * Timer callback that publishes the depth and drop count of the pipeline queues summed over all the cameras.
+		 */
+		void onPipelineStats()
+		{
+			aruco::msg::PipelineStats message;
+
+			message.ingest_depth = 0;
+			message.detect_depth = 0;
+			message.pose_depth = 0;
+			message.publish_depth = 0;
+			message.ingest_drops = 0;
+			message.detect_drops = 0;
+			message.pose_drops = 0;
+			message.publish_drops = 0;
+
+			for(unsigned int c = 0; c < cameras.size(); c++)
+			{
+				CameraContext &camera = *cameras[c];
+
+				message.ingest_depth += camera.ingest_queue.size() + camera.compressed_queue.size();
+				message.detect_depth += camera.detect_queue.size();
+				message.pose_depth += camera.pose_queue.size();
+				message.publish_depth += camera.publish_queue.size();
+
+				message.ingest_drops += camera.ingest_queue.dropped() + camera.compressed_queue.dropped();
+				message.detect_drops += camera.detect_queue.dropped();
+				message.pose_drops += camera.pose_queue.dropped();
+				message.publish_drops += camera.publish_queue.dropped();
+			}
 
-	//Aruco makers passed as parameters
-	for(unsigned int i = 0; i < 1024; i++)
-	{
-        node->get_parameter_or<string>("marker"+to_string(i),data,"");
-        if(data != "")
+			message.frames_received = frames_received.load();
+			message.frames_published = frames_published.load();
+
+			pub_pipeline_stats->publish(message);
+		}
+
+		/**
+		 * On camera info callback.
+		 * Used to receive camera calibration parameters.
+		 * @param camera Camera of the calibration.
+		 */
+		void onCameraInfo(CameraContext &camera, const sensor_msgs::msg::CameraInfo::SharedPtr msg)
 		{
-			string data;
-            node->get_parameter_or<string>("marker" + to_string(i), data, "1_0_0_0_0_0_0");
+			if(camera.calibrate(*msg) && debug)
+			{
+				cout << "Camera calibration param received " << camera.topic << endl;
+				cout << "Camera: " << camera.calibration << endl;
+				cout << "Distortion: " << camera.distortion << endl;
+			}
+		}
 
-			double values[7];
-			stringToDoubleArray(data, values, 7, "_");
+		/**
+		 * Callback to register markers on the marker list.
+		 * This callback received a custom marker message.
+		 */
+		void onMarkerRegister(const aruco::msg::Marker::SharedPtr msg)
+		{
+			if(known.contains(msg->id))
+			{
+				cout << "Marker " << to_string(msg->id) << " already exists, was replaced." << endl;
+			}
 
-			//Use OpenCV coordinates
-			if(use_opencv_coords)
+			if(known.add(ArucoMarkerInfo(msg->id, msg->size, Point3d(msg->posx, msg->posy, msg->posz), Point3d(msg->rotx, msg->roty, msg->rotz))))
 			{
-				known.push_back(ArucoMarkerInfo(i, values[0], Point3d(values[1], values[2], values[3]), Point3d(values[4], values[5], values[6])));
+				cout << "Marker " << to_string(msg->id) << " added." << endl;
 			}
-			//Convert coordinates (-Y, -Z, +X)
 			else
 			{
-				known.push_back(ArucoMarkerInfo(i, values[0], Point3d(-values[2], -values[3], -values[1]), Point3d(-values[5], -values[6], values[4])));
+				cout << "Marker " << to_string(msg->id) << " is not a valid id." << endl;
 			}
 		}
-	}
 
-	//Print all known markers
-	if(debug)
-	{
-		for(unsigned int i = 0; i < known.size(); i++)
+		/**
+		 * Convert a list of marker messages to marker infos.
+		 * @param markers Marker messages.
+		 * @return Marker infos.
+		 */
+		static vector<ArucoMarkerInfo> toMarkerInfos(const vector<aruco::msg::Marker> &markers)
 		{
-			known[i].print();
+			vector<ArucoMarkerInfo> infos;
+			infos.reserve(markers.size());
+
+			for(unsigned int i = 0; i < markers.size(); i++)
+			{
+				const aruco::msg::Marker &marker = markers[i];
+				infos.push_back(ArucoMarkerInfo(marker.id, marker.size, Point3d(marker.posx, marker.posy, marker.posz), Point3d(marker.rotx, marker.roty, marker.rotz)));
+			}
+
+			return infos;
 		}
-	}
-
-	//Subscribed topic names
-	string topic_camera, topic_camera_info, topic_marker_register, topic_marker_remove;
-    node->get_parameter_or<string>("topic_camera", topic_camera, "/rgb/image");
-    node->get_parameter_or<string>("topic_camera_info", topic_camera_info, "/rgb/camera_info");
-    node->get_parameter_or<string>("topic_marker_register", topic_marker_register, "/marker_register");
-    node->get_parameter_or<string>("topic_marker_remove", topic_marker_remove, "/marker_remove");
-
-	//Publish topic names
-	string topic_visible, topic_position, topic_rotation, topic_pose;
-    node->get_parameter_or<string>("topic_visible", topic_visible, "/visible");
-    node->get_parameter_or<string>("topic_position", topic_position, "/position");
-    node->get_parameter_or<string>("topic_rotation", topic_rotation, "/rotation");
-    node->get_parameter_or<string>("topic_pose", topic_pose, "/pose");
-
-    std::cout << "camera: " << topic_camera << std::endl << "info: " << topic_camera_info << std::endl
-              << "marker_register: " << topic_marker_register << std::endl << "marker_remove:" << topic_marker_remove << std::endl
-              << "topic_visible: " << topic_visible << std::endl << "topic_position: " << topic_position << std::endl;
-
-	//Advertise topics
-    pub_visible = node->create_publisher<std_msgs::msg::Bool>( topic_visible, rmw_qos_profile_default);
-    pub_position = node->create_publisher<geometry_msgs::msg::Point>( topic_position, rmw_qos_profile_default);
-    pub_rotation = node->create_publisher<geometry_msgs::msg::Point>(topic_rotation, rmw_qos_profile_default);
-    pub_pose = node->create_publisher<geometry_msgs::msg::PoseStamped>( topic_pose, rmw_qos_profile_default);
-    //Subscribe topics
-    //image_transport::ImageTransport it(node);
-    //image_transport::Subscriber sub_camera = it.subscribe(topic_camera, 1, onFrame);
-    auto sub_image = node->create_subscription<sensor_msgs::msg::Image>(topic_camera, onFrame, rmw_qos_profile_default);
-
-    auto sub_camera_info = node->create_subscription<sensor_msgs::msg::CameraInfo>(topic_camera_info, onCameraInfo, rmw_qos_profile_default);
-    auto sub_marker_register = node->create_subscription<aruco::msg::Marker>(topic_marker_register, onMarkerRegister, rmw_qos_profile_default);
-    auto sub_marker_remove = node->create_subscription<std_msgs::msg::Int32>(topic_marker_remove, onMarkerRemove, rmw_qos_profile_default);
-
-    rclcpp::spin(node);
-
-    std::cerr << "Shutdown" << std::endl;
-    rclcpp::shutdown();
-
-	return 0;
-}
+
+		/**
+		 * Callback to register a list of markers at once.
+		 * The registry is copied and published once for the whole list, markers already registered are replaced.
+		 */
+		void onMarkerArray(const aruco::msg::MarkerArray::SharedPtr msg)
+		{
+			unsigned int count = known.add(toMarkerInfos(msg->markers));
+			cout << to_string(count) << " of " << to_string(msg->markers.size()) << " markers added." << endl;
+		}
+
+		/**
+		 * Service to load a marker map, the markers are added to the registry or replace all the registered markers.
+		 * A replaced map is installed in a single swap so frames never see a partially loaded map.
+		 */
+		void onLoadMarkers(const shared_ptr<aruco::srv::LoadMarkers::Request> request, shared_ptr<aruco::srv::LoadMarkers::Response> response)
+		{
+			vector<ArucoMarkerInfo> infos = toMarkerInfos(request->markers);
+
+			response->loaded = request->replace ? known.replace(infos) : known.add(infos);
+			response->success = response->loaded == request->markers.size();
+
+			cout << to_string(response->loaded) << " of " << to_string(request->markers.size()) << " markers " << (request->replace ? "loaded." : "added.") << endl;
+		}
+
+		/**
+		 * Callback to remove markers from the marker list.
+		 * Markers are removed by publishing the remove ID to the remove topic.
+		 */
+		void onMarkerRemove(const std_msgs::msg::Int32::SharedPtr msg)
+		{
+			if(known.remove(msg->data))
+			{
+				cout << "Marker " << to_string(msg->data) << " removed." << endl;
+			}
+		}
+};
+
+RCLCPP_COMPONENTS_REGISTER_NODE(ArucoNode)
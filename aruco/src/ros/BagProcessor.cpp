@@ -0,0 +1,630 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <condition_variable>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp/serialization.hpp"
+
+#include "rosbag2_cpp/reader.hpp"
+#include "rosbag2_cpp/writer.hpp"
+#include "rosbag2_storage/storage_filter.hpp"
+
+#include "aruco/msg/marker_detections.hpp"
+
+#include "CameraContext.cpp"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Consecutive image messages of a bag processed by one worker.
+ * Each chunk has its own camera contexts, the first frames of the chunk repeat the last frames of the previous chunk to warm up the threshold block size, tracking and pose state, their results are not written.
+ */
+class BagChunk
+{
+	public:
+		/**
+		 * Image messages of the chunk in bag order and the camera of each message.
+		 */
+		vector<shared_ptr<rosbag2_storage::SerializedBagMessage>> messages;
+		vector<unsigned int> cameras;
+
+		/**
+		 * Number of messages at the start of the chunk used only to warm up the cameras.
+		 */
+		size_t warmup;
+
+		/**
+		 * Camera contexts of the chunk, with the parameters and calibration known when the chunk was created.
+		 */
+		vector<unique_ptr<CameraContext>> contexts;
+
+		/**
+		 * Camera info messages read after the chunk was created, the camera of each one and the index of the first message processed after it.
+		 * The contexts are calibrated at the same position of the bag as the cameras of the node.
+		 */
+		vector<sensor_msgs::msg::CameraInfo> calibrations;
+		vector<unsigned int> calibration_cameras;
+		vector<size_t> calibration_positions;
+
+		/**
+		 * Result of each message, null if the image could not be converted.
+		 */
+		vector<shared_ptr<PipelineFrame>> frames;
+
+		/**
+		 * True after a worker processed the chunk.
+		 */
+		bool done;
+
+		BagChunk()
+		{
+			warmup = 0;
+			done = false;
+		}
+};
+
+/**
+ * Offline processor for recorded rosbag2 files, runs the detection and pose code of the node as fast as possible.
+ * The bag is split in chunks of consecutive frames processed in parallel by a worker pool, the results are written in the bag order with the receive time of the source image.
+ * Uses the same parameters as the node (cameras, calibration, detector, pose and markers), camera info messages in the bag calibrate the cameras that were not calibrated by parameters.
+ */
+class BagProcessor : public rclcpp::Node
+{
+	public:
+		/**
+		 * Camera settings read from the parameters and updated by the camera info messages of the bag.
+		 */
+		vector<unique_ptr<CameraContext>> cameras;
+
+		/**
+		 * Camera info topic of each camera.
+		 */
+		vector<string> topic_camera_infos;
+
+		/**
+		 * Known markers.
+		 */
+		ArucoMarkerRegistry known;
+
+		/**
+		 * Transport of the recorded images, "raw" or "compressed".
+		 */
+		string image_transport;
+
+		/**
+		 * Output topic names, with more than one camera they are placed in the namespace of each camera.
+		 */
+		string topic_visible, topic_position, topic_rotation, topic_pose, topic_markers;
+
+		/**
+		 * Number of worker threads, by default all the available cores are used.
+		 */
+		int workers;
+
+		/**
+		 * Number of frames written by each chunk and number of frames of the previous chunk repeated to warm up the cameras.
+		 * With a chunk size of 0 the whole bag is processed by a single worker and the results are the same as the node without dropped frames.
+		 */
+		int chunk_size;
+		int chunk_overlap;
+
+		/**
+		 * Chunks waiting to be written in bag order and chunks waiting for a worker.
+		 */
+		deque<shared_ptr<BagChunk>> pending;
+		deque<shared_ptr<BagChunk>> work;
+
+		/**
+		 * Protects the chunk queues, workers wait on work_available and the writer waits on chunk_done.
+		 */
+		mutex lock;
+		condition_variable work_available;
+		condition_variable chunk_done;
+
+		/**
+		 * False when all the chunks were submitted.
+		 */
+		bool reading;
+
+		/**
+		 * Output bag or CSV file, the output is a CSV file if its name ends with ".csv".
+		 */
+		rosbag2_cpp::Writer writer;
+		ofstream csv;
+		bool use_csv;
+
+		/**
+		 * Number of frames read and frames with a pose written.
+		 */
+		unsigned long frames_read;
+		unsigned long frames_visible;
+
+		/**
+		 * Create the processor and read the parameters.
+		 * @param options Node options, parameters are declared automatically from the overrides.
+		 */
+		BagProcessor(const rclcpp::NodeOptions &options = rclcpp::NodeOptions()) : Node("aruco_bag", rclcpp::NodeOptions(options).automatically_declare_parameters_from_overrides(true))
+		{
+			bool use_opencv_coords;
+			get_parameter_or<bool>("use_opencv_coords", use_opencv_coords, false);
+			get_parameter_or<string>("image_transport", image_transport, "raw");
+			get_parameter_or<int>("workers", workers, (int) thread::hardware_concurrency());
+			get_parameter_or<int>("chunk_size", chunk_size, 200);
+			get_parameter_or<int>("chunk_overlap", chunk_overlap, 20);
+
+			get_parameter_or<string>("topic_visible", topic_visible, "/visible");
+			get_parameter_or<string>("topic_position", topic_position, "/position");
+			get_parameter_or<string>("topic_rotation", topic_rotation, "/rotation");
+			get_parameter_or<string>("topic_pose", topic_pose, "/pose");
+			get_parameter_or<string>("topic_markers", topic_markers, "/markers");
+
+			//Camera list, topic_camera is used if no list is provided
+			string topic_camera, topic_camera_info;
+			get_parameter_or<string>("topic_camera", topic_camera, "/rgb/image");
+			get_parameter_or<string>("topic_camera_info", topic_camera_info, "/rgb/camera_info");
+
+			vector<string> topic_cameras;
+			get_parameter_or<vector<string>>("topic_cameras", topic_cameras, vector<string>());
+			get_parameter_or<vector<string>>("topic_camera_infos", topic_camera_infos, vector<string>());
+
+			if(topic_cameras.size() == 0)
+			{
+				topic_cameras.push_back(topic_camera);
+				topic_camera_infos = vector<string>(1, topic_camera_info);
+			}
+
+			for(unsigned int c = 0; c < topic_cameras.size(); c++)
+			{
+				CameraContext *camera = new CameraContext(c, topic_cameras[c]);
+				cameras.push_back(unique_ptr<CameraContext>(camera));
+				camera->readParameters(*this);
+
+				if(c >= topic_camera_infos.size())
+				{
+					topic_camera_infos.push_back(cameraNamespace(camera->topic) + "/camera_info");
+				}
+			}
+
+			readMarkerParameters(*this, known, use_opencv_coords);
+
+			frames_read = 0;
+			frames_visible = 0;
+			reading = true;
+			use_csv = false;
+		}
+
+		/**
+		 * Get the namespace of a camera from its image topic, "/front/rgb/image" is in the "/front/rgb" namespace.
+		 * @param topic Camera image topic.
+		 * @return Camera namespace.
+		 */
+		static string cameraNamespace(string topic)
+		{
+			size_t pos = topic.find_last_of('/');
+			return pos == string::npos ? "" : topic.substr(0, pos);
+		}
+
+		/**
+		 * Get the topic where the images of a camera were recorded.
+		 * @param camera Camera index.
+		 * @return Image topic.
+		 */
+		string imageTopic(unsigned int camera)
+		{
+			return image_transport == "compressed" ? cameras[camera]->topic + "/compressed" : cameras[camera]->topic;
+		}
+
+		/**
+		 * Process a bag and write the results.
+		 * @param input Input bag.
+		 * @param output Output bag or CSV file.
+		 */
+		void process(string input, string output)
+		{
+			use_csv = output.size() > 4 && output.substr(output.size() - 4) == ".csv";
+
+			if(use_csv)
+			{
+				csv.open(output);
+				csv << "stamp,camera,visible,position_x,position_y,position_z,rotation_x,rotation_y,rotation_z,markers" << endl << setprecision(9);
+			}
+			else
+			{
+				writer.open(output);
+			}
+
+			rosbag2_cpp::Reader reader;
+			reader.open(input);
+
+			rosbag2_storage::StorageFilter filter;
+
+			for(unsigned int c = 0; c < cameras.size(); c++)
+			{
+				filter.topics.push_back(imageTopic(c));
+				filter.topics.push_back(topic_camera_infos[c]);
+			}
+
+			reader.set_filter(filter);
+
+			//Worker pool
+			vector<thread> threads;
+
+			for(int i = 0; i < std::max(workers, 1); i++)
+			{
+				threads.push_back(thread(&BagProcessor::workerLoop, this));
+			}
+
+			double start = StageTimer::now();
+
+			//Last messages of the previous chunk, repeated at the start of the next chunk
+			deque<shared_ptr<rosbag2_storage::SerializedBagMessage>> history;
+			deque<unsigned int> history_cameras;
+
+			shared_ptr<BagChunk> chunk;
+			rclcpp::Serialization<sensor_msgs::msg::CameraInfo> info_serialization;
+
+			while(reader.has_next())
+			{
+				shared_ptr<rosbag2_storage::SerializedBagMessage> message = reader.read_next();
+
+				for(unsigned int c = 0; c < cameras.size(); c++)
+				{
+					if(message->topic_name == topic_camera_infos[c])
+					{
+						sensor_msgs::msg::CameraInfo info;
+						rclcpp::SerializedMessage serialized(*message->serialized_data);
+						info_serialization.deserialize_message(&serialized, &info);
+
+						//The open chunk copied the calibration when it was created, it is calibrated before its next message
+						if(cameras[c]->calibrate(info) && chunk != nullptr)
+						{
+							chunk->calibrations.push_back(info);
+							chunk->calibration_cameras.push_back(c);
+							chunk->calibration_positions.push_back(chunk->messages.size());
+						}
+					}
+					else if(message->topic_name == imageTopic(c))
+					{
+						if(chunk == nullptr)
+						{
+							chunk = createChunk(history, history_cameras);
+						}
+
+						chunk->messages.push_back(message);
+						chunk->cameras.push_back(c);
+						frames_read++;
+
+						if(chunk_overlap > 0)
+						{
+							history.push_back(message);
+							history_cameras.push_back(c);
+
+							if(history.size() > (size_t) chunk_overlap)
+							{
+								history.pop_front();
+								history_cameras.pop_front();
+							}
+						}
+
+						if(chunk_size > 0 && chunk->messages.size() - chunk->warmup >= (size_t) chunk_size)
+						{
+							submit(chunk);
+							chunk = nullptr;
+						}
+					}
+				}
+			}
+
+			if(chunk != nullptr)
+			{
+				submit(chunk);
+			}
+
+			{
+				lock_guard<mutex> guard(lock);
+				reading = false;
+			}
+
+			work_available.notify_all();
+			flush(true);
+
+			for(unsigned int i = 0; i < threads.size(); i++)
+			{
+				threads[i].join();
+			}
+
+			double time = (StageTimer::now() - start) / 1000.0;
+
+			cout << frames_read << " frames (" << frames_visible << " with pose) in " << time << " s, " << frames_read / time << " frames/s" << endl;
+
+			if(use_csv)
+			{
+				csv.close();
+			}
+		}
+
+		/**
+		 * Create a chunk with a copy of the current camera settings, the warm up messages are added to the start of the chunk.
+		 * @param history Last messages of the previous chunk.
+		 * @param history_cameras Camera of each history message.
+		 * @return New chunk.
+		 */
+		shared_ptr<BagChunk> createChunk(const deque<shared_ptr<rosbag2_storage::SerializedBagMessage>> &history, const deque<unsigned int> &history_cameras)
+		{
+			shared_ptr<BagChunk> chunk = make_shared<BagChunk>();
+
+			for(unsigned int c = 0; c < cameras.size(); c++)
+			{
+				CameraContext *context = new CameraContext(c, cameras[c]->topic);
+				context->copyParameters(*cameras[c]);
+				chunk->contexts.push_back(unique_ptr<CameraContext>(context));
+			}
+
+			chunk->messages.assign(history.begin(), history.end());
+			chunk->cameras.assign(history_cameras.begin(), history_cameras.end());
+			chunk->warmup = history.size();
+
+			return chunk;
+		}
+
+		/**
+		 * Queue a chunk for the workers, waits while too many chunks are waiting to be written so the memory used is bounded.
+		 * @param chunk Chunk to process.
+		 */
+		void submit(shared_ptr<BagChunk> chunk)
+		{
+			{
+				lock_guard<mutex> guard(lock);
+				pending.push_back(chunk);
+				work.push_back(chunk);
+			}
+
+			work_available.notify_one();
+			flush(false);
+		}
+
+		/**
+		 * Write the processed chunks in bag order.
+		 * @param all If true waits for all the chunks, otherwise only waits while more than two chunks per worker are pending.
+		 */
+		void flush(bool all)
+		{
+			unique_lock<mutex> guard(lock);
+			size_t limit = 2 * std::max(workers, 1);
+
+			while(!pending.empty())
+			{
+				if(!pending.front()->done)
+				{
+					if(!all && pending.size() < limit)
+					{
+						break;
+					}
+
+					chunk_done.wait(guard);
+					continue;
+				}
+
+				shared_ptr<BagChunk> chunk = pending.front();
+				pending.pop_front();
+
+				guard.unlock();
+				write(*chunk);
+				guard.lock();
+			}
+		}
+
+		/**
+		 * Worker thread, processes chunks until all the chunks are read.
+		 */
+		void workerLoop()
+		{
+			unique_lock<mutex> guard(lock);
+
+			while(true)
+			{
+				if(work.empty())
+				{
+					if(!reading)
+					{
+						return;
+					}
+
+					work_available.wait(guard);
+					continue;
+				}
+
+				shared_ptr<BagChunk> chunk = work.front();
+				work.pop_front();
+
+				guard.unlock();
+				processChunk(*chunk);
+				guard.lock();
+
+				chunk->done = true;
+				chunk_done.notify_all();
+			}
+		}
+
+		/**
+		 * Detect the markers and solve the pose of the frames of a chunk in bag order, the pose messages are stamped with the image stamp.
+		 * @param chunk Chunk to process.
+		 */
+		void processChunk(BagChunk &chunk)
+		{
+			rclcpp::Serialization<sensor_msgs::msg::Image> image_serialization;
+			rclcpp::Serialization<sensor_msgs::msg::CompressedImage> compressed_serialization;
+
+			shared_ptr<const ArucoMarkerRegistry::Table> table = known.snapshot();
+
+			chunk.frames.resize(chunk.messages.size());
+
+			unsigned int calibration = 0;
+
+			for(unsigned int i = 0; i < chunk.messages.size(); i++)
+			{
+				//Camera info messages read before this message
+				while(calibration < chunk.calibrations.size() && chunk.calibration_positions[calibration] <= i)
+				{
+					chunk.contexts[chunk.calibration_cameras[calibration]]->calibrate(chunk.calibrations[calibration]);
+					calibration++;
+				}
+
+				CameraContext &camera = *chunk.contexts[chunk.cameras[i]];
+				rclcpp::SerializedMessage serialized(*chunk.messages[i]->serialized_data);
+				shared_ptr<PipelineFrame> frame;
+
+				if(image_transport == "compressed")
+				{
+					sensor_msgs::msg::CompressedImage::SharedPtr msg = make_shared<sensor_msgs::msg::CompressedImage>();
+					compressed_serialization.deserialize_message(&serialized, msg.get());
+					frame = PipelineFrame::fromCompressed(msg);
+				}
+				else
+				{
+					sensor_msgs::msg::Image::SharedPtr msg = make_shared<sensor_msgs::msg::Image>();
+					image_serialization.deserialize_message(&serialized, msg.get());
+					frame = PipelineFrame::fromImage(msg);
+				}
+
+				if(frame == nullptr)
+				{
+					continue;
+				}
+
+				camera.detect(*frame);
+				camera.solvePose(*frame, *table, frame->stamp);
+
+				//Only the results are kept
+				frame->image = Mat();
+				frame->bridge = nullptr;
+				frame->msg = nullptr;
+
+				if(i >= chunk.warmup)
+				{
+					chunk.frames[i] = frame;
+				}
+			}
+		}
+
+		/**
+		 * Write the results of a chunk, the messages are written with the receive time of their source image.
+		 * @param chunk Processed chunk.
+		 */
+		void write(BagChunk &chunk)
+		{
+			for(unsigned int i = chunk.warmup; i < chunk.messages.size(); i++)
+			{
+				shared_ptr<PipelineFrame> frame = chunk.frames[i];
+
+				if(frame == nullptr)
+				{
+					continue;
+				}
+
+				unsigned int camera = chunk.cameras[i];
+
+				if(frame->visible)
+				{
+					frames_visible++;
+				}
+
+				if(use_csv)
+				{
+					writeCsv(camera, *frame);
+					continue;
+				}
+
+				string prefix = cameras.size() > 1 ? cameraNamespace(cameras[camera]->topic) : "";
+				rclcpp::Time time = rclcpp::Time(chunk.messages[i]->time_stamp);
+
+				if(frame->visible)
+				{
+					writer.write(frame->position, prefix + topic_position, time);
+					writer.write(frame->rotation, prefix + topic_rotation, time);
+					writer.write(frame->pose, prefix + topic_pose, time);
+				}
+
+				std_msgs::msg::Bool message_visible;
+				message_visible.data = frame->visible;
+				writer.write(message_visible, prefix + topic_visible, time);
+
+				aruco::msg::MarkerDetections message_markers;
+				message_markers.header.stamp = frame->stamp;
+				message_markers.header.frame_id = "aruco";
+
+				for(unsigned int m = 0; m < frame->markers.size(); m++)
+				{
+					message_markers.ids.push_back(frame->markers[m].id);
+
+					for(unsigned int k = 0; k < frame->markers[m].projected.size(); k++)
+					{
+						message_markers.corners.push_back(frame->markers[m].projected[k].x);
+						message_markers.corners.push_back(frame->markers[m].projected[k].y);
+					}
+				}
+
+				writer.write(message_markers, prefix + topic_markers, time);
+			}
+		}
+
+		/**
+		 * Write a line of the CSV output, the ids of the markers detected are separated by spaces.
+		 * @param camera Camera index.
+		 * @param frame Processed frame.
+		 */
+		void writeCsv(unsigned int camera, const PipelineFrame &frame)
+		{
+			csv << rclcpp::Time(frame.stamp).seconds() << "," << cameras[camera]->topic << "," << frame.visible;
+
+			if(frame.visible)
+			{
+				csv << "," << frame.position.x << "," << frame.position.y << "," << frame.position.z << "," << frame.rotation.x << "," << frame.rotation.y << "," << frame.rotation.z << ",";
+			}
+			else
+			{
+				csv << ",,,,,,,";
+			}
+
+			for(unsigned int m = 0; m < frame.markers.size(); m++)
+			{
+				csv << (m > 0 ? " " : "") << frame.markers[m].id;
+			}
+
+			csv << endl;
+		}
+};
+
+/**
+ * Offline processing of recorded bags.
+ * Usage: aruco_bag input_bag output [--ros-args --params-file params.yaml]
+ * The output is a bag with the pose, position, rotation, visible and markers topics of each camera, or a CSV file if its name ends with ".csv".
+ * @param argc Number of arguments.
+ * @param argv Value of the arguments.
+ */
+int main(int argc, char **argv)
+{
+	vector<string> args = rclcpp::init_and_remove_ros_arguments(argc, argv);
+
+	if(args.size() < 3)
+	{
+		cerr << "Usage: aruco_bag input_bag output [--ros-args --params-file params.yaml]" << endl;
+		rclcpp::shutdown();
+		return 1;
+	}
+
+	shared_ptr<BagProcessor> processor = make_shared<BagProcessor>();
+	processor->process(args[1], args[2]);
+
+	rclcpp::shutdown();
+
+	return 0;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+/**
+ * Thread safe queue with a fixed capacity used to connect the node pipeline stages.
+ * When the queue is full the oldest item is dropped so the consumer always gets the most recent data.
+ */
+template <typename T>
+class BoundedQueue
+{
+	public:
+		/**
+		 * Maximum number of items stored in the queue.
+		 */
+		size_t capacity;
+
+		/**
+		 * Items waiting to be consumed.
+		 */
+		deque<T> items;
+
+		/**
+		 * Number of items dropped because the queue was full.
+		 */
+		unsigned long drops;
+
+		/**
+		 * Number of items pushed into the queue.
+		 */
+		unsigned long pushed;
+
+		/**
+		 * When closed pop returns false once the queue is empty.
+		 */
+		bool closed;
+
+		mutex lock;
+		condition_variable available;
+
+		BoundedQueue(size_t _capacity = 1)
+		{
+			capacity = _capacity > 0 ? _capacity : 1;
+			drops = 0;
+			pushed = 0;
+			closed = false;
+		}
+
+		/**
+		 * Push an item into the queue, if the queue is full the oldest item is dropped.
+		 * @param item Item to push.
+		 * @return True if an item was dropped.
+		 */
+		bool push(T item)
+		{
+			bool dropped = false;
+
+			{
+				lock_guard<mutex> guard(lock);
+
+				if(items.size() >= capacity)
+				{
+					items.pop_front();
+					drops++;
+					dropped = true;
+				}
+
+				items.push_back(std::move(item));
+				pushed++;
+			}
+
+			available.notify_one();
+
+			return dropped;
+		}
+
+		/**
+		 * Wait for an item and remove it from the queue.
+		 * @param item Output item.
+		 * @return False if the queue was closed and has no more items.
+		 */
+		bool pop(T &item)
+		{
+			unique_lock<mutex> guard(lock);
+			available.wait(guard, [this]{return closed || !items.empty();});
+
+			if(items.empty())
+			{
+				return false;
+			}
+
+			item = std::move(items.front());
+			items.pop_front();
+
+			return true;
+		}
+
+		/**
+		 * Remove an item from the queue without waiting.
+		 * @param item Output item.
+		 * @return False if the queue is empty.
+		 */
+		bool tryPop(T &item)
+		{
+			lock_guard<mutex> guard(lock);
+
+			if(items.empty())
+			{
+				return false;
+			}
+
+			item = std::move(items.front());
+			items.pop_front();
+
+			return true;
+		}
+
+		/**
+		 * Close the queue and wake up all consumers.
+		 */
+		void close()
+		{
+			{
+				lock_guard<mutex> guard(lock);
+				closed = true;
+			}
+
+			available.notify_all();
+		}
+
+		/**
+		 * Get the number of items waiting in the queue.
+		 * @return Queue depth.
+		 */
+		size_t size()
+		{
+			lock_guard<mutex> guard(lock);
+			return items.size();
+		}
+
+		/**
+		 * Get the number of items dropped.
+		 * @return Drop count.
+		 */
+		unsigned long dropped()
+		{
+			lock_guard<mutex> guard(lock);
+			return drops;
+		}
+};
@@ -0,0 +1,817 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+//Image decoding is in highgui in OpenCV 2 and in its own module since OpenCV 3
+#if CV_MAJOR_VERSION == 2
+	#include <opencv2/highgui/highgui.hpp>
+#else
+	#include <opencv2/imgcodecs/imgcodecs.hpp>
+#endif
+
+#include "rclcpp/rclcpp.hpp"
+
+#include "std_msgs/msg/bool.hpp"
+#include "geometry_msgs/msg/point.hpp"
+#include "geometry_msgs/msg/pose_stamped.hpp"
+#include "sensor_msgs/image_encodings.hpp"
+#include "sensor_msgs/msg/image.hpp"
+#include "sensor_msgs/msg/compressed_image.hpp"
+#include "sensor_msgs/msg/camera_info.hpp"
+
+#include "cv_bridge/cv_bridge.h"
+
+#include "aruco/msg/frame_diagnostics.hpp"
+
+#include "../ArucoMarker.cpp"
+#include "../ArucoMarkerInfo.cpp"
+#include "../ArucoMarkerRegistry.cpp"
+#include "../ArucoDetector.cpp"
+#include "../StageTimer.cpp"
+#include "../PoseEstimator.cpp"
+#include "BoundedQueue.cpp"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Converts a string with numeric values separated by a delimiter to an array of double values.
+ * If 0_1_2_3 and delimiter is _ array will contain {0, 1, 2, 3}.
+ * @param data String to be converted
+ * @param values Array to store values on
+ * @param cout Number of elements in the string
+ * @param delimiter Separator element
+ * @return Array with values.
+ */
+void stringToDoubleArray(string data, double* values, unsigned int count, string delimiter)
+{
+	unsigned int pos = 0, k = 0;
+
+	while((pos = data.find(delimiter)) != string::npos && k < count)
+	{
+		string token = data.substr(0, pos);
+		values[k] = stod(token);
+		data.erase(0, pos + delimiter.length());
+		k++;
+	}
+
+	//Last value is not followed by a delimiter
+	if(k < count && data != "")
+	{
+		values[k] = stod(data);
+	}
+}
+
+/**
+ * Register the markers passed as parameters (marker0 to marker1023) of a node.
+ * Each marker is described as size_posx_posy_posz_rotx_roty_rotz.
+ * @param node Node with the parameters.
+ * @param known Registry where the markers are registered.
+ * @param use_opencv_coords If false the markers are converted from ROS to OpenCV coordinates.
+ */
+void readMarkerParameters(rclcpp::Node &node, ArucoMarkerRegistry &known, bool use_opencv_coords)
+{
+	vector<ArucoMarkerInfo> infos;
+
+	for(unsigned int i = 0; i < ArucoMarkerRegistry::IDS; i++)
+	{
+		string data;
+		node.get_parameter_or<string>("marker" + to_string(i), data, "");
+
+		if(data != "")
+		{
+			double values[7] = {1, 0, 0, 0, 0, 0, 0};
+			stringToDoubleArray(data, values, 7, "_");
+
+			//Use OpenCV coordinates
+			if(use_opencv_coords)
+			{
+				infos.push_back(ArucoMarkerInfo(i, values[0], Point3d(values[1], values[2], values[3]), Point3d(values[4], values[5], values[6])));
+			}
+			//Convert coordinates (-Y, -Z, +X)
+			else
+			{
+				infos.push_back(ArucoMarkerInfo(i, values[0], Point3d(-values[2], -values[3], -values[1]), Point3d(-values[5], -values[6], values[4])));
+			}
+		}
+	}
+
+	known.add(infos);
+}
+
+/**
+ * Frame flowing through the node pipeline stages.
+ */
+class PipelineFrame
+{
+	public:
+		/**
+		 * Image message and its OpenCV bridge, keep the image data alive when it is shared.
+		 */
+		sensor_msgs::msg::Image::SharedPtr msg;
+		cv_bridge::CvImageConstPtr bridge;
+
+		/**
+		 * Image used for detection, grayscale or BGR.
+		 */
+		Mat image;
+
+		/**
+		 * Stamp of the source image message.
+		 */
+		builtin_interfaces::msg::Time stamp;
+
+		/**
+		 * Markers detected in the image and the known markers used for pose estimation.
+		 */
+		vector<ArucoMarker> markers;
+		vector<ArucoMarker> found;
+
+		/**
+		 * Threshold block size used to detect the markers.
+		 */
+		int block_size;
+
+		/**
+		 * Cosine limit, minimum area and max polygon error used to detect the markers, shown by the debug window.
+		 */
+		float cosine_limit;
+		int min_area;
+		float max_error_quad;
+
+		/**
+		 * True if a known marker is visible and the pose messages are valid.
+		 */
+		bool visible;
+
+		/**
+		 * Rotation (Rodrigues) and translation of the world relative to the camera, used to draw the debug origin.
+		 */
+		Mat world_rotation, world_position;
+
+		/**
+		 * Camera pose messages.
+		 */
+		geometry_msgs::msg::Point position, rotation;
+		geometry_msgs::msg::PoseStamped pose;
+
+		/**
+		 * Time in milliseconds spent in each stage and number of quads decoded, only measured when ARUCO_PROFILE is enabled.
+		 */
+		double conversion_time = 0.0, threshold_time = 0.0, contours_time = 0.0, decode_time = 0.0, pnp_time = 0.0, publish_time = 0.0;
+		unsigned int candidates = 0;
+
+		/**
+		 * Number of contours found and rejected by each quad check.
+		 */
+		SquareFinder::Stats square_stats;
+
+		/**
+		 * Create a frame from an image message, the image data is shared with the message when possible.
+		 * @param msg Image message.
+		 * @return Frame or null if the image could not be converted.
+		 */
+		static shared_ptr<PipelineFrame> fromImage(const sensor_msgs::msg::Image::SharedPtr &msg)
+		{
+			try
+			{
+				#if ARUCO_PROFILE
+					double time = StageTimer::now();
+				#endif
+
+				shared_ptr<PipelineFrame> frame = make_shared<PipelineFrame>();
+				frame->msg = msg;
+				frame->stamp = msg->header.stamp;
+
+				//Mono images are used directly without copying or converting them
+				if(msg->encoding == sensor_msgs::image_encodings::MONO8)
+				{
+					frame->bridge = cv_bridge::toCvShare(msg);
+				}
+				else
+				{
+					frame->bridge = cv_bridge::toCvShare(msg, "bgr8");
+				}
+
+				frame->image = frame->bridge->image;
+
+				#if ARUCO_PROFILE
+					frame->conversion_time = StageTimer::now() - time;
+				#endif
+
+				return frame;
+			}
+			catch(cv_bridge::Exception& e)
+			{
+				std::cerr << "Error getting image data" << std::endl;
+			}
+
+			return nullptr;
+		}
+
+		/**
+		 * Create a frame from a compressed image message, decodes the JPEG or PNG data to an OpenCV image.
+		 * Grayscale images are kept single channel so the detector does not need to convert them.
+		 * @param msg Compressed image message.
+		 * @return Frame or null if the image could not be decoded.
+		 */
+		static shared_ptr<PipelineFrame> fromCompressed(const sensor_msgs::msg::CompressedImage::SharedPtr &msg)
+		{
+			#if ARUCO_PROFILE
+				double time = StageTimer::now();
+			#endif
+
+			shared_ptr<PipelineFrame> frame = make_shared<PipelineFrame>();
+			frame->stamp = msg->header.stamp;
+			frame->image = imdecode(Mat(msg->data), IMREAD_UNCHANGED);
+
+			if(frame->image.empty())
+			{
+				std::cerr << "Error decoding " << msg->format << " image data" << std::endl;
+				return nullptr;
+			}
+
+			//16 bit PNG images are reduced to 8 bit
+			if(frame->image.depth() != CV_8U)
+			{
+				frame->image.convertTo(frame->image, CV_8U, 1.0 / 256.0);
+			}
+
+			#if ARUCO_PROFILE
+				frame->conversion_time = StageTimer::now() - time;
+			#endif
+
+			return frame;
+		}
+};
+
+/**
+ * Pipeline stages, the frames of each camera go through the stages in this order.
+ */
+enum PipelineStage
+{
+	STAGE_INGEST = 0,
+	STAGE_DETECT = 1,
+	STAGE_POSE = 2,
+	STAGE_PUBLISH = 3,
+	STAGE_COUNT = 4
+};
+
+/**
+ * Camera processed by the node, each camera has its own calibration, detector, adaptive threshold state, pipeline queues and output topics.
+ * The detection and pose code is shared by the node and the offline bag processor, so both produce the same poses for the same frames.
+ */
+class CameraContext
+{
+	public:
+		/**
+		 * Index of the camera in the node camera list.
+		 */
+		unsigned int index;
+
+		/**
+		 * Image topic of the camera.
+		 */
+		string topic;
+
+		/**
+		 * Camera calibration matrix pre initialized with calibration values for the test camera.
+		 */
+		double data_calibration[9] = {570.3422241210938, 0, 319.5, 0, 570.3422241210938, 239.5, 0, 0, 1};
+		Mat calibration;
+
+		/**
+		 * Lenses distortion matrix initialized with values for the test camera.
+		 */
+		double data_distortion[5] = {0, 0, 0, 0, 0};
+		Mat distortion;
+
+		/**
+		 * Flag to check if calibration parameters were received.
+		 * If set to false the camera will be calibrated when a camera info message is received.
+		 */
+		bool calibrated;
+
+		/**
+		 * Protects the calibration that is updated by the camera info callback.
+		 */
+		mutex calibration_mutex;
+
+		/**
+		 * Flag to determine if OpenCV or ROS coordinates are used.
+		 */
+		bool use_opencv_coords;
+
+		/**
+		 * Aruco detector instance, keeps its buffers and tracking state between frames of the camera.
+		 */
+		ArucoDetector detector;
+
+		/**
+		 * Pose estimator, keeps the pose of the previous frame of the camera to seed the solver.
+		 */
+		PoseEstimator pose_estimator;
+
+		/**
+		 * Cosine limit used during the quad detection phase.
+		 * Value between 0 and 1.
+		 * By default 0.8 is used.
+		 * The bigger the value more distortion tolerant the square detection will be.
+		 */
+		float cosine_limit;
+
+		/**
+		 * Maximum error to be used by geometry poly aproximation method in the quad detection phase.
+		 * By default 0.035 is used.
+		 */
+		float max_error_quad;
+
+		/**
+		 * Threshold block size, adapts to the images of the camera.
+		 */
+		int theshold_block_size;
+
+		/**
+		 * Minimum threshold block size.
+		 * By default 5 is used.
+		 */
+		int theshold_block_size_min;
+
+		/**
+		 * Maximum threshold block size.
+		 * By default 9 is used.
+		 */
+		int theshold_block_size_max;
+
+		/**
+		 * If true when the camera has no markers visible all the block sizes between the minimum and maximum are tested on the same frame.
+		 * The block size is then set to the average of the ones that found the most markers.
+		 * By default false is used (one block size is tested per frame).
+		 */
+		bool block_search;
+
+		/**
+		 * Block sizes tested by the block size search.
+		 */
+		vector<int> block_sizes;
+
+		/**
+		 * Minimum area considered for aruco markers.
+		 * Should be a value high enough to filter blobs out but detect the smallest marker necessary.
+		 * By default 100 is used.
+		 */
+		int min_area;
+
+		/**
+		 * True if markers were found in the last frame of the camera, used by the block size search.
+		 */
+		bool locked;
+
+		/**
+		 * Key pressed in the debug window of the camera, applied by the detect stage that owns the detector parameters.
+		 */
+		atomic<int> debug_key;
+
+		/**
+		 * Queues between the pipeline stages, when full the oldest frame is dropped.
+		 */
+		BoundedQueue<sensor_msgs::msg::Image::SharedPtr> ingest_queue;
+		BoundedQueue<sensor_msgs::msg::CompressedImage::SharedPtr> compressed_queue;
+		BoundedQueue<shared_ptr<PipelineFrame>> detect_queue;
+		BoundedQueue<shared_ptr<PipelineFrame>> pose_queue;
+		BoundedQueue<shared_ptr<PipelineFrame>> publish_queue;
+
+		/**
+		 * Stages of the camera being run by a worker, each stage runs one frame at a time so frames keep their order.
+		 * Protected by the node schedule mutex.
+		 */
+		bool busy[STAGE_COUNT];
+
+		/**
+		 * Output publishers of the camera.
+		 */
+		rclcpp::Publisher<std_msgs::msg::Bool>::SharedPtr pub_visible;
+		rclcpp::Publisher<geometry_msgs::msg::Point>::SharedPtr pub_position;
+		rclcpp::Publisher<geometry_msgs::msg::Point>::SharedPtr pub_rotation;
+		rclcpp::Publisher<geometry_msgs::msg::PoseStamped>::SharedPtr pub_pose;
+		rclcpp::Publisher<aruco::msg::FrameDiagnostics>::SharedPtr pub_frame_diagnostics;
+
+		/**
+		 * Subscriptions of the camera.
+		 */
+		rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr sub_image;
+		rclcpp::Subscription<sensor_msgs::msg::CompressedImage>::SharedPtr sub_compressed;
+		rclcpp::Subscription<sensor_msgs::msg::CameraInfo>::SharedPtr sub_camera_info;
+
+		CameraContext(unsigned int _index, string _topic, size_t capacity = 1)
+		{
+			index = _index;
+			topic = _topic;
+			calibrated = false;
+			use_opencv_coords = false;
+			cosine_limit = 0.7;
+			max_error_quad = 0.035;
+			theshold_block_size = 7;
+			theshold_block_size_min = 3;
+			theshold_block_size_max = 21;
+			block_search = false;
+			min_area = 100;
+			locked = false;
+			debug_key = -1;
+
+			calibration = Mat(3, 3, CV_64F, data_calibration);
+			distortion = Mat(1, 5, CV_64F, data_distortion);
+
+			ingest_queue.capacity = capacity;
+			compressed_queue.capacity = capacity;
+			detect_queue.capacity = capacity;
+			pose_queue.capacity = capacity;
+			publish_queue.capacity = capacity;
+
+			for(int i = 0; i < STAGE_COUNT; i++)
+			{
+				busy[i] = false;
+			}
+		}
+
+		/**
+		 * Read the detector, pose and calibration parameters of a node, the same parameters are used by all the cameras of the node.
+		 * @param node Node with the parameters.
+		 */
+		void readParameters(rclcpp::Node &node)
+		{
+			bool pose_warm_start, pose_square_solver, tracking, contour_tracer, prune_children, suppress_duplicates;
+			int threads, tile_size, tracking_interval, decimation;
+			double max_aspect;
+			string quad_backend;
+
+			node.get_parameter_or<bool>("use_opencv_coords", use_opencv_coords, false);
+			node.get_parameter_or<float>("cosine_limit", cosine_limit, 0.7);
+			node.get_parameter_or<int>("theshold_block_size_min", theshold_block_size_min, 3);
+			node.get_parameter_or<int>("theshold_block_size_max", theshold_block_size_max, 21);
+			node.get_parameter_or<bool>("block_search", block_search, false);
+			node.get_parameter_or<bool>("pose_warm_start", pose_warm_start, true);
+			node.get_parameter_or<bool>("pose_square_solver", pose_square_solver, true);
+			node.get_parameter_or<float>("max_error_quad", max_error_quad, 0.035);
+			node.get_parameter_or<int>("min_area", min_area, 100);
+			node.get_parameter_or<double>("max_aspect", max_aspect, SquareFinder::MAX_ASPECT);
+			node.get_parameter_or<int>("threads", threads, 1);
+			node.get_parameter_or<int>("tile_size", tile_size, 0);
+			node.get_parameter_or<bool>("tracking", tracking, false);
+			node.get_parameter_or<int>("tracking_interval", tracking_interval, 10);
+			node.get_parameter_or<int>("decimation", decimation, 1);
+			node.get_parameter_or<bool>("contour_tracer", contour_tracer, false);
+			node.get_parameter_or<string>("quad_backend", quad_backend, contour_tracer ? "tracer" : "contours");
+			node.get_parameter_or<bool>("prune_children", prune_children, false);
+			node.get_parameter_or<bool>("suppress_duplicates", suppress_duplicates, true);
+			node.get_parameter_or<bool>("calibrated", calibrated, false);
+
+			//Initial threshold block size
+			theshold_block_size = (theshold_block_size_min + theshold_block_size_max) / 2;
+			if(theshold_block_size % 2 == 0)
+			{
+				theshold_block_size++;
+			}
+
+			//Block sizes tested by the block size search
+			block_sizes.clear();
+
+			for(int size = theshold_block_size_min | 1; size <= theshold_block_size_max && block_sizes.size() < 32; size += 2)
+			{
+				block_sizes.push_back(size);
+			}
+
+			//Detector threads
+			detector.threads = threads;
+			detector.tileSize = tile_size;
+
+			//Detector tracking
+			detector.tracking = tracking;
+			detector.trackingInterval = tracking_interval;
+			detector.decimation = decimation;
+
+			//Quad candidates source
+			if(!SquareFinder::backendFromName(quad_backend, detector.backend))
+			{
+				cout << "Unknown quad backend " << quad_backend << ", using contours." << endl;
+				detector.backend = BACKEND_CONTOURS;
+			}
+
+			detector.pruneChildren = prune_children;
+			detector.maxAspect = max_aspect;
+			detector.suppressDuplicates = suppress_duplicates;
+
+			//Pose solver
+			pose_estimator.warmStart = pose_warm_start;
+			pose_estimator.squareSolver = pose_square_solver;
+
+			//Camera instrinsic calibration parameters
+			string values_calibration, values_distortion;
+			node.get_parameter_or<string>("calibration", values_calibration, "");
+			node.get_parameter_or<string>("distortion", values_distortion, "");
+
+			if(values_calibration != "")
+			{
+				stringToDoubleArray(values_calibration, data_calibration, 9, "_");
+				calibrated = true;
+			}
+
+			//Camera distortion calibration parameters
+			if(values_distortion != "")
+			{
+				stringToDoubleArray(values_distortion, data_distortion, 5, "_");
+				calibrated = true;
+			}
+		}
+
+		/**
+		 * Copy the parameters and calibration of another camera, the detector and pose state are not copied.
+		 * @param source Camera to copy.
+		 */
+		void copyParameters(CameraContext &source)
+		{
+			use_opencv_coords = source.use_opencv_coords;
+			cosine_limit = source.cosine_limit;
+			max_error_quad = source.max_error_quad;
+			theshold_block_size = source.theshold_block_size;
+			theshold_block_size_min = source.theshold_block_size_min;
+			theshold_block_size_max = source.theshold_block_size_max;
+			block_search = source.block_search;
+			block_sizes = source.block_sizes;
+			min_area = source.min_area;
+
+			detector.threads = source.detector.threads;
+			detector.tileSize = source.detector.tileSize;
+			detector.tracking = source.detector.tracking;
+			detector.trackingInterval = source.detector.trackingInterval;
+			detector.decimation = source.detector.decimation;
+			detector.backend = source.detector.backend;
+			detector.pruneChildren = source.detector.pruneChildren;
+			detector.maxAspect = source.detector.maxAspect;
+			detector.suppressDuplicates = source.detector.suppressDuplicates;
+
+			pose_estimator.warmStart = source.pose_estimator.warmStart;
+			pose_estimator.squareSolver = source.pose_estimator.squareSolver;
+			pose_estimator.maxError = source.pose_estimator.maxError;
+
+			lock_guard<mutex> guard(source.calibration_mutex);
+
+			calibrated = source.calibrated;
+			source.calibration.copyTo(calibration);
+			source.distortion.copyTo(distortion);
+		}
+
+		/**
+		 * Set the calibration of the camera from a camera info message, only the first message is used.
+		 * @param msg Camera info message.
+		 * @return True if the calibration was set.
+		 */
+		bool calibrate(const sensor_msgs::msg::CameraInfo &msg)
+		{
+			lock_guard<mutex> guard(calibration_mutex);
+
+			if(calibrated)
+			{
+				return false;
+			}
+
+			calibrated = true;
+
+			for(unsigned int i = 0; i < 9; i++)
+			{
+				calibration.at<double>(i / 3, i % 3) = msg.k[i];
+			}
+
+			for(unsigned int i = 0; i < 5 && i < msg.d.size(); i++)
+			{
+				distortion.at<double>(0, i) = msg.d[i];
+			}
+
+			return true;
+		}
+
+		/**
+		 * Find the markers in a frame of the camera and adapt the threshold block size.
+		 * This is the only method that uses the camera detector and its parameters.
+		 * @param frame Frame to process.
+		 */
+		void detect(PipelineFrame &frame)
+		{
+			//Process image and get markers
+			detector.limitCosine = cosine_limit;
+			detector.thresholdBlockSize = theshold_block_size;
+			detector.minArea = min_area;
+			detector.maxError = max_error_quad;
+
+			//The edges backend does not threshold, the block size is not searched nor adapted
+			bool thresholded = detector.backend != BACKEND_EDGES;
+
+			//Without markers visible search all the block sizes in the same frame
+			if(block_search && !locked && thresholded)
+			{
+				detector.blockSizes = block_sizes;
+			}
+			else
+			{
+				detector.blockSizes.clear();
+			}
+
+			frame.markers = detector.detect(frame.image);
+			frame.candidates = detector.candidateCount;
+			frame.square_stats = detector.squareStats;
+			locked = frame.markers.size() > 0;
+
+			if(detector.blockSizes.size() > 0 && locked)
+			{
+				theshold_block_size = detector.bestBlockSize;
+			}
+
+			frame.block_size = theshold_block_size;
+			frame.cosine_limit = cosine_limit;
+			frame.min_area = min_area;
+			frame.max_error_quad = max_error_quad;
+
+			#if ARUCO_PROFILE
+				frame.conversion_time += detector.conversionTime;
+				frame.threshold_time = detector.thresholdTime;
+				frame.contours_time = detector.contoursTime;
+				frame.decode_time = detector.decodeTime;
+			#endif
+
+			if(!block_search && frame.markers.size() == 0 && thresholded)
+			{
+				theshold_block_size += 2;
+
+				if(theshold_block_size > theshold_block_size_max)
+				{
+					theshold_block_size = theshold_block_size_min;
+				}
+			}
+		}
+
+		/**
+		 * Calculate the camera pose from the known markers visible in a frame and fill the pose messages of the frame.
+		 * @param frame Frame with the detected markers.
+		 * @param table Known markers.
+		 * @param stamp Stamp of the pose message.
+		 */
+		void solvePose(PipelineFrame &frame, const ArucoMarkerRegistry::Table &table, builtin_interfaces::msg::Time stamp)
+		{
+			#if ARUCO_PROFILE
+				double time = StageTimer::now();
+			#endif
+
+			vector<ArucoMarker> &markers = frame.markers;
+
+			//Vector of points
+			vector<Point2f> projected;
+			vector<Point3f> world;
+
+			Mat camera_calibration, camera_distortion;
+
+			{
+				lock_guard<mutex> guard(calibration_mutex);
+
+				camera_calibration = calibration.clone();
+				camera_distortion = distortion.clone();
+			}
+
+			//Check known markers and build known of points
+			for(unsigned int i = 0; i < markers.size(); i++)
+			{
+				const ArucoMarkerInfo *info = table.get(markers[i].id);
+
+				if(info != nullptr)
+				{
+					markers[i].attachInfo(*info);
+
+					for(unsigned int k = 0; k < 4; k++)
+					{
+						projected.push_back(markers[i].projected[k]);
+						world.push_back(info->world[k]);
+					}
+
+					frame.found.push_back(markers[i]);
+				}
+			}
+
+			//Calculate position and rotation, seeded with the pose of the previous frame
+			frame.visible = pose_estimator.solve(world, projected, camera_calibration, camera_distortion);
+
+			//Check if any marker was found
+			if(frame.visible)
+			{
+				Mat rotation = pose_estimator.rotation.clone();
+				Mat position = pose_estimator.position.clone();
+
+				frame.world_rotation = rotation;
+				frame.world_position = position;
+
+				//Invert position and rotation to get camera coords
+				Mat rodrigues;
+				Rodrigues(rotation, rodrigues);
+
+				Mat camera_rotation;
+				Rodrigues(rodrigues.t(), camera_rotation);
+
+				Mat camera_position = -rodrigues.t() * position;
+
+				geometry_msgs::msg::Point &message_position = frame.position;
+				geometry_msgs::msg::Point &message_rotation = frame.rotation;
+
+				//Opencv coordinates
+				if(use_opencv_coords)
+				{
+					message_position.x = camera_position.at<double>(0, 0);
+					message_position.y = camera_position.at<double>(1, 0);
+					message_position.z = camera_position.at<double>(2, 0);
+
+					message_rotation.x = camera_rotation.at<double>(0, 0);
+					message_rotation.y = camera_rotation.at<double>(1, 0);
+					message_rotation.z = camera_rotation.at<double>(2, 0);
+				}
+				//Robot coordinates
+				else
+				{
+					message_position.x = camera_position.at<double>(2, 0);
+					message_position.y = -camera_position.at<double>(0, 0);
+					message_position.z = -camera_position.at<double>(1, 0);
+
+					message_rotation.x = camera_rotation.at<double>(2, 0);
+					message_rotation.y = -camera_rotation.at<double>(0, 0);
+					message_rotation.z = -camera_rotation.at<double>(1, 0);
+				}
+
+				geometry_msgs::msg::PoseStamped &message_pose = frame.pose;
+
+				//Header
+				message_pose.header.frame_id = "aruco";
+				message_pose.header.stamp = stamp;
+
+				//Position
+				message_pose.pose.position.x = message_position.x;
+				message_pose.pose.position.y = message_position.y;
+				message_pose.pose.position.z = message_position.z;
+
+				//Convert to quaternion
+				double x = message_rotation.x;
+				double y = message_rotation.y;
+				double z = message_rotation.z;
+
+				//Module of angular velocity
+				double angle = sqrt(x*x + y*y + z*z);
+
+				if(angle > 0.0)
+				{
+					message_pose.pose.orientation.x = x * sin(angle/2.0)/angle;
+					message_pose.pose.orientation.y = y * sin(angle/2.0)/angle;
+					message_pose.pose.orientation.z = z * sin(angle/2.0)/angle;
+					message_pose.pose.orientation.w = cos(angle/2.0);
+				}
+				//To avoid illegal expressions
+				else
+				{
+					message_pose.pose.orientation.x = 0.0;
+					message_pose.pose.orientation.y = 0.0;
+					message_pose.pose.orientation.z = 0.0;
+					message_pose.pose.orientation.w = 1.0;
+				}
+			}
+
+			#if ARUCO_PROFILE
+				frame.pnp_time = StageTimer::now() - time;
+			#endif
+		}
+
+		/**
+		 * Check if a stage of the camera has frames waiting.
+		 * @param stage Pipeline stage.
+		 * @return True if the stage queue is not empty.
+		 */
+		bool pending(int stage)
+		{
+			if(stage == STAGE_INGEST)
+			{
+				return ingest_queue.size() + compressed_queue.size() > 0;
+			}
+			else if(stage == STAGE_DETECT)
+			{
+				return detect_queue.size() > 0;
+			}
+			else if(stage == STAGE_POSE)
+			{
+				return pose_queue.size() > 0;
+			}
+
+			return publish_queue.size() > 0;
+		}
+};